@@ -69,31 +69,10 @@ infobanner_create(struct client * c)
 	infobanner_update(c);
 }
 
-static void
-fetch_utf8_name(Display * d, Window w, char **name)
-{
-#ifndef NOUTF8
-	Atom        actual_type;
-	int         format;
-	unsigned long dummy;
-	unsigned long name_len;
-
-	XGetWindowProperty(d, w, xa_net_wm_name, 0, -1, False,
-		xa_utf8_string, &actual_type, &format,
-		&name_len, &dummy, (unsigned char **) name);
-#define _NOUTF8 0
-#else
-#define _NOUTF8 1
-#endif
-	if (_NOUTF8 || !*name) {
-		XFetchName(dpy, w, name);
-	}
-}
-
 static void
 infobanner_update(struct client * c)
 {
-	char       *name;
+	char       *name = c->name;
 	char        buf[27];
 	int         iwinx, iwiny, iwinw, iwinh;
 	int         width_inc = c->width_inc, height_inc = c->height_inc;
@@ -107,7 +86,6 @@ infobanner_update(struct client * c)
 	iwinw = XTextWidth(font, buf, strlen(buf)) + 2;
 	iwinh = font->max_bounds.ascent + font->max_bounds.descent;
 
-	fetch_utf8_name(dpy, c->window, &name);
 	if (name) {
 #ifdef PANGO
 		int         namew, nameh;
@@ -147,7 +125,6 @@ infobanner_update(struct client * c)
 		XDrawString(dpy, info_window, c->screen->invert_gc,
 			1, iwinh / 2 - 1, name, strlen(name));
 #endif
-		XFree(name);
 	}
 	XDrawString(dpy, info_window, c->screen->invert_gc, 1, iwinh - 1,
 		buf, strlen(buf));
@@ -445,11 +422,26 @@ struct annotate_ctx
 };
 typedef struct annotate_ctx annotate_ctx_t;
 
-annotate_ctx_t annotate_info_ctx = { NULL, &ANNOTATE_INFOBANNER, NULL };
-annotate_ctx_t annotate_drag_ctx =
-	{ &shape_outline, &ANNOTATE_MOVERESIZE, &shape_cog };
-annotate_ctx_t annotate_sweep_ctx =
-	{ &shape_outline, &ANNOTATE_MOVERESIZE, &shape_cog };
+#define ANNOTATE_INFO_CTX { NULL, &ANNOTATE_INFOBANNER, NULL }
+#define ANNOTATE_DRAG_CTX { &shape_outline, &ANNOTATE_MOVERESIZE, &shape_cog }
+#define ANNOTATE_SWEEP_CTX { &shape_outline, &ANNOTATE_MOVERESIZE, &shape_cog }
+
+annotate_ctx_t annotate_info_ctx = ANNOTATE_INFO_CTX;
+annotate_ctx_t annotate_drag_ctx = ANNOTATE_DRAG_CTX;
+annotate_ctx_t annotate_sweep_ctx = ANNOTATE_SWEEP_CTX;
+
+/* Restore the compile time defaults before the configuration is re-read */
+void
+annotate_reset(void)
+{
+	static const annotate_ctx_t info = ANNOTATE_INFO_CTX;
+	static const annotate_ctx_t drag = ANNOTATE_DRAG_CTX;
+	static const annotate_ctx_t sweep = ANNOTATE_SWEEP_CTX;
+
+	annotate_info_ctx = info;
+	annotate_drag_ctx = drag;
+	annotate_sweep_ctx = sweep;
+}
 
 /*
  * Annotation functions
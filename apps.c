@@ -0,0 +1,215 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Matching new clients against -app rules.
+ *
+ * Once the configuration is read, apps_compile() files each rule in one of
+ * three places: a hash table keyed by instance name if it gives an exact
+ * name, else one keyed by class if it gives an exact class, else a short
+ * list of rules using shell-style wildcards (or neither field).  Matching
+ * a client then means walking two hash chains and the wildcard list,
+ * rather than every rule.  Rules that match are applied in the order the
+ * whole list would have applied them. */
+
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include "evilwm.h"
+#include "log.h"
+
+struct rule
+{
+	struct application *app;
+	int         order;	/* position in applications list */
+	int         next;	/* next rule in the same chain, or -1 */
+};
+
+static struct rule *rules = NULL;
+static int  num_rules = 0;
+static int *name_hash = NULL;
+static int *class_hash = NULL;
+static unsigned int hash_mask;
+static int  pattern_rules = -1;
+static int *matched = NULL;
+
+static int
+is_pattern(const char *s)
+{
+	return s && strpbrk(s, "*?[") != NULL;
+}
+
+/* FNV-1a */
+static unsigned int
+hash_string(const char *s)
+{
+	unsigned int h = 2166136261u;
+
+	while (*s) {
+		h ^= (unsigned char) *(s++);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static int
+field_matches(const char *rule, const char *value)
+{
+	if (!rule)
+		return 1;
+	if (!value)
+		return 0;
+	if (is_pattern(rule))
+		return fnmatch(rule, value, 0) == 0;
+	return strcmp(rule, value) == 0;
+}
+
+/** apps_compile:
+ *  Build the rule index from the applications list.  Call after the
+ *  configuration has been read, and again whenever it changes.
+ */
+void
+apps_compile(void)
+{
+	struct list *iter;
+	unsigned int size;
+	int         n = 0;
+
+	free(rules);
+	free(name_hash);
+	free(class_hash);
+	free(matched);
+	rules = NULL;
+	name_hash = class_hash = matched = NULL;
+	num_rules = 0;
+	pattern_rules = -1;
+
+	for (iter = applications; iter; iter = iter->next)
+		n++;
+	if (!n)
+		return;
+	size = 16;
+	while (size < (unsigned) n * 2)
+		size <<= 1;
+	rules = malloc(n * sizeof(struct rule));
+	name_hash = malloc(size * sizeof(int));
+	class_hash = malloc(size * sizeof(int));
+	matched = malloc(n * sizeof(int));
+	if (!rules || !name_hash || !class_hash || !matched) {
+		LOG_ERROR("out of memory compiling application rules\n");
+		free(rules);
+		free(name_hash);
+		free(class_hash);
+		free(matched);
+		rules = NULL;
+		name_hash = class_hash = matched = NULL;
+		return;
+	}
+	hash_mask = size - 1;
+	for (unsigned int i = 0; i < size; i++)
+		name_hash[i] = class_hash[i] = -1;
+
+	/* Chains are built by prepending, so walk the rules backwards to
+	 * keep each chain in list order. */
+	n = 0;
+	for (iter = applications; iter; iter = iter->next)
+		rules[n++].app = iter->data;
+	num_rules = n;
+	while (n--) {
+		struct application *a = rules[n].app;
+		int        *head;
+
+		rules[n].order = n;
+		if (a->res_name && !is_pattern(a->res_name))
+			head = &name_hash[hash_string(a->res_name) & hash_mask];
+		else if (a->res_class && !is_pattern(a->res_class))
+			head = &class_hash[hash_string(a->res_class) & hash_mask];
+		else
+			head = &pattern_rules;
+		rules[n].next = *head;
+		*head = n;
+	}
+	LOG_DEBUG("compiled %d application rules\n", num_rules);
+}
+
+static int
+match_chain(int i, struct client * c, int nmatched)
+{
+	for (; i >= 0; i = rules[i].next) {
+		struct application *a = rules[i].app;
+
+		if (field_matches(a->res_name, c->res_name)
+			&& field_matches(a->res_class, c->res_class))
+			matched[nmatched++] = rules[i].order;
+	}
+	return nmatched;
+}
+
+static int
+cmp_order(const void *a, const void *b)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+/* Returns 1 if the rule gave a position */
+static int
+apply_app(struct client * c, struct application * a)
+{
+	int         screen_x, screen_y;
+
+	if (a->geometry_mask & WidthValue)
+		c->width = a->width * c->width_inc;
+	if (a->geometry_mask & HeightValue)
+		c->height = a->height * c->height_inc;
+	/* Warning: these co-ordinates are in screen co-ordinates */
+	if (!(a->geometry_mask & XValue)) {
+		screen_x = client_to_Xcoord(c, x);
+	} else {
+		if (a->geometry_mask & XNegative)
+			screen_x = a->x + DisplayWidth(dpy, c->screen->screen)
+				- c->width - c->border;
+		else
+			screen_x = a->x + c->border;
+	}
+	if (!(a->geometry_mask & YValue)) {
+		screen_y = client_to_Xcoord(c, y);
+	} else {
+		if (a->geometry_mask & YNegative)
+			screen_y = a->y + DisplayHeight(dpy, c->screen->screen)
+				- c->height - c->border;
+		else
+			screen_y = a->y + c->border;
+	}
+	client_update_screenpos(c, screen_x, screen_y);
+	moveresizeraise(c);
+	if (a->is_dock)
+		c->is_dock = 1;
+	if (a->vdesk != VDESK_NONE)
+		c->vdesk = a->vdesk;
+	return (a->geometry_mask & (XValue | YValue)) != 0;
+}
+
+/** apps_apply:
+ *  Apply every -app rule matching the client's cached instance name and
+ *  class.  Returns 1 if any of them positioned the client.
+ */
+int
+apps_apply(struct client * c)
+{
+	int         n = 0, positioned = 0;
+
+	if (!num_rules)
+		return 0;
+	if (c->res_name)
+		n = match_chain(name_hash[hash_string(c->res_name) & hash_mask],
+			c, n);
+	if (c->res_class)
+		n = match_chain(class_hash[hash_string(c->res_class)
+				& hash_mask], c, n);
+	n = match_chain(pattern_rules, c, n);
+	if (n > 1)
+		qsort(matched, n, sizeof(int), cmp_order);
+	for (int i = 0; i < n; i++)
+		positioned |= apply_app(c, rules[matched[i]].app);
+	return positioned;
+}
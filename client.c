@@ -12,20 +12,17 @@
 static int  send_xmessage(Window w, Atom a, long x);
 
 /* used all over the place.  return the client that has specified window as
- * either window or parent */
+ * either window or parent.  Both are recorded against client_context as
+ * the client is created, so this is a hash lookup. */
 
 struct client     *
 find_client(Window w)
 {
-	struct list *iter;
-
-	for (iter = clients_tab_order; iter; iter = iter->next) {
-		struct client     *c = iter->data;
+	XPointer    data;
 
-		if (w == c->parent || w == c->window)
-			return c;
-	}
-	return NULL;
+	if (w == None || XFindContext(dpy, w, client_context, &data) != 0)
+		return NULL;
+	return (struct client *) data;
 }
 
 void
@@ -34,13 +31,32 @@ client_hide(struct client * c)
 	c->ignore_unmap++;	/* Ignore unmap so we don't remove client */
 	XUnmapWindow(dpy, c->parent);
 	set_wm_state(c, IconicState);
+	c->mapped = 0;
+	occlusion_touch(c);
+	freeze_client_hidden(c);
 }
 
 void
 client_show(struct client * c)
 {
+	freeze_client_shown(c);
 	XMapWindow(dpy, c->parent);
 	set_wm_state(c, NormalState);
+	c->mapped = 1;
+	occlusion_touch(c);
+}
+
+/* Stamps given to clients moved to the top and bottom of the stacking
+ * order, so that two clients' stacking can be compared without walking
+ * clients_stacking_order */
+static long stack_top = 0;
+static long stack_bottom = 0;
+
+/* Note that @c has just been put at the top of clients_stacking_order */
+void
+client_stacked_top(struct client * c)
+{
+	c->stack_stamp = ++stack_top;
 }
 
 void
@@ -48,7 +64,9 @@ client_raise(struct client * c)
 {
 	XRaiseWindow(dpy, c->parent);
 	clients_stacking_order = list_to_tail(clients_stacking_order, c);
+	client_stacked_top(c);
 	ewmh_set_net_client_list_stacking(c->screen);
+	occlusion_touch(c);
 }
 
 /* This doesn't just call XLowerWindow(), as that could push the window
@@ -78,7 +96,10 @@ client_lower(struct client * c)
 	clients_stacking_order = list_delete(clients_stacking_order, c);
 	clients_stacking_order =
 		list_insert_before(clients_stacking_order, iter, c);
+	/* Below everything it shares a screen with; others don't matter */
+	c->stack_stamp = --stack_bottom;
 	ewmh_set_net_client_list_stacking(c->screen);
+	occlusion_touch(c);
 }
 
 /** client_calc_cog:
@@ -104,6 +125,8 @@ client_calc_phy(struct client * c)
 	if (c->vdesk != VDESK_FIXED && c->vdesk != c->phy->vdesk) {
 		c->vdesk = c->phy->vdesk;
 		ewmh_set_net_wm_desktop(c);
+		spatial_update(c);
+		mru_update(c);
 	}
 }
 
@@ -155,6 +178,67 @@ send_config(struct client * c)
 
 	XSendEvent(dpy, c->window, False, StructureNotifyMask,
 		(XEvent *) & ce);
+	c->sent.config_x = ce.x;
+	c->sent.config_y = ce.y;
+	stats.config_notify_sent++;
+}
+
+/** client_commit_geometry:
+ *  Bring the server's idea of the frame and client window in line with
+ *  the client's geometry, sending only what differs from what was last
+ *  sent.  The client is told its new position with a synthetic
+ *  ConfigureNotify if (and only if) that changed; returns true if it was.
+ */
+bool
+client_commit_geometry(struct client * c)
+{
+	XWindowChanges wc;
+	unsigned int mask = 0;
+
+	wc.x = client_to_Xcoord(c, x) - c->border;
+	wc.y = client_to_Xcoord(c, y) - c->border;
+	wc.width = c->width;
+	wc.height = c->height;
+	wc.border_width = c->border;
+	if (wc.x != c->sent.x)
+		mask |= CWX;
+	if (wc.y != c->sent.y)
+		mask |= CWY;
+	if (wc.width != c->sent.width)
+		mask |= CWWidth;
+	if (wc.height != c->sent.height)
+		mask |= CWHeight;
+	if (wc.border_width != c->sent.border)
+		mask |= CWBorderWidth;
+	if (mask) {
+		XConfigureWindow(dpy, c->parent, mask, &wc);
+		c->sent.x = wc.x;
+		c->sent.y = wc.y;
+		c->sent.width = wc.width;
+		c->sent.height = wc.height;
+		c->sent.border = wc.border_width;
+		stats.geometry_sent++;
+	} else {
+		stats.geometry_suppressed++;
+	}
+
+	/* The client window always sits at 0,0 in its frame */
+	if (c->width != c->sent.win_width || c->height != c->sent.win_height) {
+		XResizeWindow(dpy, c->window, c->width, c->height);
+		c->sent.win_width = c->width;
+		c->sent.win_height = c->height;
+		stats.geometry_sent++;
+	} else {
+		stats.geometry_suppressed++;
+	}
+
+	if (client_to_Xcoord(c, x) != c->sent.config_x
+		|| client_to_Xcoord(c, y) != c->sent.config_y) {
+		send_config(c);
+		return true;
+	}
+	stats.config_notify_suppressed++;
+	return false;
 }
 
 /* Shift client to show border according to window's gravity. */
@@ -208,6 +292,7 @@ gravitate_border(struct client * c, int bw)
 void
 select_client(struct client * c)
 {
+	focus_cancel();
 	if (current)
 		XSetWindowBorder(dpy, current->parent,
 			current->screen->bg.pixel);
@@ -224,7 +309,9 @@ select_client(struct client * c)
 			CurrentTime);
 	}
 	current = c;
+	mru_touch(c);
 	ewmh_set_net_active_window(c);
+	boost_client_focused(c);
 }
 
 /** client_to_vdesk:
@@ -235,6 +322,8 @@ client_to_vdesk(struct client * c, unsigned int vdesk)
 {
 	if (valid_vdesk(vdesk)) {
 		c->vdesk = vdesk;
+		spatial_update(c);
+		mru_update(c);
 		if (is_fixed(c) || c->vdesk == c->phy->vdesk) {
 			client_show(c);
 		} else {
@@ -245,14 +334,30 @@ client_to_vdesk(struct client * c, unsigned int vdesk)
 	}
 }
 
+/* Clients flagged for removal, oldest first */
+static struct list *removal_queue = NULL;
+static int  removal_queue_length = 0;
+
+/** queue_remove_client:
+ *  Flag a client as withdrawn.  It is released along with any others
+ *  flagged by the next remove_queued_clients().
+ */
 void
-remove_client(struct client * c)
+queue_remove_client(struct client * c)
 {
-	LOG_ENTER("remove_client(window=%lx, %s)", c->window,
-		c->remove ? "withdrawing" : "wm quitting");
+	if (c->remove)
+		return;
+	c->remove = 1;
+	removal_queue = list_append(removal_queue, c);
+	removal_queue_length++;
+}
 
-	XGrabServer(dpy);
-	ignore_xerror = 1;
+/* Release a client; the caller grabs the server and syncs afterwards */
+static void
+release_client(struct client * c)
+{
+	LOG_ENTER("release_client(window=%lx, %s)", c->window,
+		c->remove ? "withdrawing" : "wm quitting");
 
 	/* ICCCM 4.1.3.1
 	 * "When the window is withdrawn, the window manager will either
@@ -281,50 +386,111 @@ remove_client(struct client * c)
 	XRemoveFromSaveSet(dpy, c->window);
 	if (c->parent)
 		XDestroyWindow(dpy, c->parent);
+	XDeleteContext(dpy, c->window, client_context);
+	if (c->parent)
+		XDeleteContext(dpy, c->parent, client_context);
 
+	occlusion_forget(c);
+	spatial_remove(c);
+	mru_remove(c);
+	focus_client_removed(c);
+	freeze_client_removed(c);
 	clients_tab_order = list_delete(clients_tab_order, c);
 	clients_mapping_order = list_delete(clients_mapping_order, c);
 	clients_stacking_order = list_delete(clients_stacking_order, c);
-	/* If the wm is quitting, we'll remove the client list properties
-	 * soon enough, otherwise: */
-	if (c->remove) {
-		ewmh_set_net_client_list(c->screen);
-		ewmh_set_net_client_list_stacking(c->screen);
-	}
 
 	if (current == c)
 		current = NULL;	/* an enter event should set this up again */
+	free(c->acct.atoms);
+	props_free(c);
 	free(c);
+	LOG_LEAVE();
+}
+
+static void
+log_window_count(void)
+{
 #ifdef DEBUG
-	{
-		struct list *iter;
-		int         i = 0;
+	struct list *iter;
+	int         i = 0;
 
-		for (iter = clients_tab_order; iter; iter = iter->next)
-			i++;
-		LOG_DEBUG("free(), window count now %d\n", i);
-	}
+	for (iter = clients_tab_order; iter; iter = iter->next)
+		i++;
+	LOG_DEBUG("window count now %d\n", i);
 #endif
+}
+
+/** remove_queued_clients:
+ *  Release every client flagged by queue_remove_client() under a single
+ *  server grab, updating each affected screen's client lists once.
+ */
+void
+remove_queued_clients(void)
+{
+	int         touched[num_screens];
 
+	if (!removal_queue)
+		return;
+	for (int i = 0; i < num_screens; i++)
+		touched[i] = 0;
+	XGrabServer(dpy);
+	ignore_xerror = 1;
+	while (removal_queue) {
+		struct client     *c = removal_queue->data;
+
+		removal_queue = list_delete(removal_queue, c);
+		touched[c->screen->screen] = 1;
+		release_client(c);
+	}
+	removal_queue_length = 0;
+	for (int i = 0; i < num_screens; i++) {
+		if (touched[i]) {
+			ewmh_set_net_client_list(&screens[i]);
+			ewmh_set_net_client_list_stacking(&screens[i]);
+		}
+	}
+	log_window_count();
 	XUngrabServer(dpy);
 	XSync(dpy, False);
 	ignore_xerror = 0;
-	LOG_LEAVE();
 }
 
+/* Is the removal queue long enough that it shouldn't wait any longer? */
+bool
+removal_queue_full(void)
+{
+	return removal_queue_length >= REMOVAL_BATCH_MAX;
+}
+
+/** remove_all_clients:
+ *  Release every client as the window manager quits, in one pass.  Window
+ *  states and EWMH properties are left for whichever window manager comes
+ *  next; the client list properties go with the screens.
+ */
 void
-send_wm_delete(struct client * c, int kill_client)
+remove_all_clients(void)
 {
-	int         i, n, found = 0;
-	Atom       *protocols;
-
-	if (!kill_client && XGetWMProtocols(dpy, c->window, &protocols, &n)) {
-		for (i = 0; i < n; i++)
-			if (protocols[i] == xa_wm_delete)
-				found++;
-		XFree(protocols);
+	XGrabServer(dpy);
+	ignore_xerror = 1;
+	/* any still queued were withdrawn and are treated as such */
+	while (removal_queue) {
+		struct client     *c = removal_queue->data;
+
+		removal_queue = list_delete(removal_queue, c);
+		release_client(c);
 	}
-	if (found)
+	removal_queue_length = 0;
+	while (clients_stacking_order)
+		release_client(clients_stacking_order->data);
+	XUngrabServer(dpy);
+	XSync(dpy, False);
+	ignore_xerror = 0;
+}
+
+void
+send_wm_delete(struct client * c, int kill_client)
+{
+	if (!kill_client && c->has_wm_delete)
 		send_xmessage(c->window, xa_wm_protos, xa_wm_delete);
 	else
 		XKillClient(dpy, c->window);
@@ -358,8 +524,14 @@ set_shape(struct client * c)
 	/* Logic to decide if we have a shaped window cribbed from fvwm-2.5.10.
 	 * Previous method (more than one rectangle returned from
 	 * XShapeGetRectangles) worked _most_ of the time. */
-	if (XShapeQueryExtents(dpy, c->window, &bounding_shaped, &i, &i,
-			&u, &u, &b, &i, &i, &u, &u) && bounding_shaped) {
+	if (!XShapeQueryExtents(dpy, c->window, &bounding_shaped, &i, &i,
+			&u, &u, &b, &i, &i, &u, &u))
+		bounding_shaped = 0;
+	if (c->shaped != bounding_shaped) {
+		c->shaped = bounding_shaped;
+		occlusion_touch(c);
+	}
+	if (bounding_shaped) {
 		LOG_DEBUG("%d shape extents\n", bounding_shaped);
 		XShapeCombineShape(dpy, c->parent, ShapeBounding, 0, 0,
 			c->window, ShapeBounding, ShapeSet);
@@ -10,6 +10,10 @@
 #include "log.h"
 
 static int  interruptibleXNextEvent(XEvent * event);
+static void run_timers(void);
+
+/* Active timers, soonest first */
+static struct timer *timers = NULL;
 
 #ifdef DEBUG
 const char *debug_atom_name(Atom a);
@@ -25,23 +29,99 @@ debug_atom_name(Atom a)
 }
 #endif
 
+/* Keyboard moves and resizes speed up while the key is held: the step is
+ * multiplied by one more for each KEY_ACCEL_REPEATS autorepeats, up to
+ * KEY_ACCEL_MAX.  A press more than KEY_HELD_GAP ms after the last one
+ * starts afresh. */
+#define KEY_ACCEL_REPEATS 8
+#define KEY_ACCEL_MAX     8
+#define KEY_HELD_GAP      250
+
+/* Lock modifiers don't change which binding a key press selects */
+#define KEY_STATE(s) ((s) & ~(LockMask | numlockmask))
+
+struct key_repeat
+{
+	unsigned int keycode;
+	unsigned int state;	/* as KEY_STATE() */
+	int         blocked;
+};
+
+/** predicate_keyrepeat:
+ *  predicate function for use with XCheckIfEvent.
+ *  Matches KeyPress and KeyRelease events for @arg's keycode and modifier
+ *  state at the head of the queue.  Anything else, including the same key
+ *  with other modifiers held, stops further matches, so events are never
+ *  taken out of order.
+ *
+ *  @arg must be a pointer to a struct key_repeat
+ */
+static Bool
+predicate_keyrepeat(Display * dummy, XEvent * ev, XPointer arg)
+{
+	(void) dummy;
+	struct key_repeat *kr = (struct key_repeat *) arg;
+
+	if (kr->blocked)
+		return False;
+	if ((ev->type == KeyPress || ev->type == KeyRelease)
+		&& ev->xkey.keycode == kr->keycode
+		&& KEY_STATE(ev->xkey.state) == kr->state)
+		return True;
+	kr->blocked = 1;
+	return False;
+}
+
+/* Fold autorepeats of a movement key already queued into this press.
+ * Returns the number of steps to move by. */
+static int
+key_repeat_steps(XKeyEvent * e)
+{
+	static unsigned int held_keycode, held_state;
+	static Time held_time;
+	static int  held;
+	struct key_repeat kr = {.keycode = e->keycode,
+		.state = KEY_STATE(e->state) };
+	Time        last = e->time;
+	int         presses = 1;
+	XEvent      ev;
+
+	while (XCheckIfEvent(dpy, &ev, predicate_keyrepeat, (XPointer) & kr)) {
+		if (ev.type == KeyPress) {
+			presses++;
+			last = ev.xkey.time;
+		}
+	}
+	stats.key_repeats_folded += presses - 1;
+	if (e->keycode == held_keycode && kr.state == held_state
+		&& e->time - held_time < KEY_HELD_GAP)
+		held += presses;
+	else
+		held = presses - 1;
+	held_keycode = e->keycode;
+	held_state = kr.state;
+	held_time = last;
+	return presses * MIN(1 + held / KEY_ACCEL_REPEATS, KEY_ACCEL_MAX);
+}
+
 static void
 handle_key_event(XKeyEvent * e)
 {
-	KeySym      key = XKeycodeToKeysym(dpy, e->keycode, 0);
+	const struct key_binding *kb = key_lookup(e->keycode, e->state);
 	struct client     *c;
 	int         width_inc, height_inc;
+	int         steps;
 	bool        move_client;
 	struct screen_info *current_screen;
 	struct physical_screen *current_phy;
 
 	find_current_screen_and_phy(&current_screen, &current_phy);
 
-	switch (key) {
-		case KEY_NEW:
-			spawn((const char *const *) opt_term);
+	switch (kb->action) {
+		case ACTION_NEW:
+			spawn_terminal();
 			break;
-		case KEY_NEXT:
+		case ACTION_NEXT:
 			next();
 			if (XGrabKeyboard(dpy, e->root, False, GrabModeAsync,
 					GrabModeAsync,
@@ -53,60 +133,57 @@ handle_key_event(XKeyEvent * e)
 						KeyPressMask | KeyReleaseMask,
 						&ev);
 					if (ev.type == KeyPress
-						&& XKeycodeToKeysym(dpy,
-							ev.xkey.keycode,
-							0) == KEY_NEXT)
+						&& ev.xkey.keycode == e->keycode)
 						next();
 				} while (ev.type == KeyPress
-					|| XKeycodeToKeysym(dpy,
-						ev.xkey.keycode,
-						0) == KEY_NEXT);
+					|| ev.xkey.keycode == e->keycode);
 				XUngrabKeyboard(dpy, CurrentTime);
 			}
+			mru_cycle_end();
 			ewmh_select_client(current);
 			break;
-		case KEY_DOCK_TOGGLE:
+		case ACTION_DOCK_TOGGLE:
 			set_docks_visible(current_screen,
 				!current_screen->docks_visible);
 			break;
-		case XK_1:
-		case XK_2:
-		case XK_3:
-		case XK_4:
-		case XK_5:
-		case XK_6:
-		case XK_7:
-		case XK_8:
-		case XK_9:
-		case XK_0:
-			switch_vdesk(current_screen, current_phy,
-				KEY_TO_VDESK(key));
+		case ACTION_VDESK:
+			defer_switch_vdesk(current_screen, current_phy,
+				kb->arg);
 			break;
-		case KEY_PREVDESK:
-			/* Find next avaliable vdesk */
-			for (unsigned i = current_phy->vdesk - 1;
+		case ACTION_PREVDESK:
+			/* Find prev avaliable vdesk, counting from any switch
+			 * still pending */
+			for (unsigned i = effective_vdesk(current_phy) - 1;
 				i < opt_vdesks; i--) {
-				if (switch_vdesk(current_screen, current_phy,
-						i))
+				if (defer_switch_vdesk(current_screen,
+						current_phy, i))
 					break;
 			}
 			break;
-		case KEY_NEXTDESK:
-			/* Find prev avaliable vdesk */
-			for (unsigned i = current_phy->vdesk + 1;
+		case ACTION_NEXTDESK:
+			/* Find next avaliable vdesk */
+			for (unsigned i = effective_vdesk(current_phy) + 1;
 				i < opt_vdesks; i++) {
-				if (switch_vdesk(current_screen, current_phy,
-						i))
+				if (defer_switch_vdesk(current_screen,
+						current_phy, i))
 					break;
 			}
 			break;
-		case KEY_TOGGLEDESK:
+		case ACTION_TOGGLEDESK:
 			switch_vdesk(current_screen, current_phy,
 				current_screen->old_vdesk);
 			break;
-		case KEY_EXGPHY:
+		case ACTION_EXGPHY:
 			exchange_phy(current_screen);
 			break;
+		case ACTION_FIND:
+			finder_run();
+			break;
+#ifdef LAUNCHER
+		case ACTION_LAUNCH:
+			launcher_run();
+			break;
+#endif
 		default:
 			break;
 	}
@@ -116,83 +193,96 @@ handle_key_event(XKeyEvent * e)
 	width_inc = (c->width_inc > 1) ? c->width_inc : 16;
 	height_inc = (c->height_inc > 1) ? c->height_inc : 16;
 	move_client = false;
-	switch (key) {
-		case KEY_LEFT:
+	switch (kb->action) {
+		case ACTION_LEFT:
+		case ACTION_DOWN:
+		case ACTION_UP:
+		case ACTION_RIGHT:
+			steps = key_repeat_steps(e);
+			break;
+		default:
+			steps = 0;
+			break;
+	}
+	switch (kb->action) {
+		case ACTION_LEFT:
 			if (e->state & altmask) {
-				if ((c->width - width_inc) >= c->min_width)
+				for (; steps && (c->width - width_inc) >=
+					c->min_width; steps--)
 					c->width -= width_inc;
 			} else {
-				c->nx -= 16;
+				c->nx -= 16 * steps;
 			}
 			move_client = true;
 			break;
-		case KEY_DOWN:
+		case ACTION_DOWN:
 			if (e->state & altmask) {
-				if (!c->max_height
-					|| (c->height + height_inc) <=
-					c->max_height)
+				for (; steps && (!c->max_height
+						|| (c->height + height_inc) <=
+						c->max_height); steps--)
 					c->height += height_inc;
 			} else {
-				c->ny += 16;
+				c->ny += 16 * steps;
 			}
 			move_client = true;
 			break;
-		case KEY_UP:
+		case ACTION_UP:
 			if (e->state & altmask) {
-				if ((c->height - height_inc) >= c->min_height)
+				for (; steps && (c->height - height_inc) >=
+					c->min_height; steps--)
 					c->height -= height_inc;
 			} else {
-				c->ny -= 16;
+				c->ny -= 16 * steps;
 			}
 			move_client = true;
 			break;
-		case KEY_RIGHT:
+		case ACTION_RIGHT:
 			if (e->state & altmask) {
-				if (!c->max_width
-					|| (c->width + width_inc) <=
-					c->max_width)
+				for (; steps && (!c->max_width
+						|| (c->width + width_inc) <=
+						c->max_width); steps--)
 					c->width += width_inc;
 			} else {
-				c->nx += 16;
+				c->nx += 16 * steps;
 			}
 			move_client = true;
 			break;
-		case KEY_TOPLEFT:
+		case ACTION_TOPLEFT:
 			c->nx = c->border;
 			c->ny = c->border;
 			move_client = true;
 			break;
-		case KEY_TOPRIGHT:
+		case ACTION_TOPRIGHT:
 			c->nx = c->phy->width - c->width - c->border;
 			c->ny = c->border;
 			move_client = true;
 			break;
-		case KEY_BOTTOMLEFT:
+		case ACTION_BOTTOMLEFT:
 			c->nx = c->border;
 			c->ny = c->phy->height - c->height - c->border;
 			move_client = true;
 			break;
-		case KEY_BOTTOMRIGHT:
+		case ACTION_BOTTOMRIGHT:
 			c->nx = c->phy->width - c->width - c->border;
 			c->ny = c->phy->height - c->height - c->border;
 			move_client = true;
 			break;
-		case KEY_LOWER:
-		case KEY_ALTLOWER:
+		case ACTION_LOWER:
+		case ACTION_ALTLOWER:
 			client_lower(c);
 			break;
-		case KEY_INFO:
+		case ACTION_INFO:
 			show_info(c, e->keycode);
 			break;
-		case KEY_MAX:
+		case ACTION_MAX:
 			maximise_client(c, NET_WM_STATE_TOGGLE,
 				MAXIMISE_HORZ | MAXIMISE_VERT);
 			break;
-		case KEY_FULLSCREEN:
+		case ACTION_FULLSCREEN:
 			maximise_client(c, NET_WM_STATE_TOGGLE,
 				MAXIMISE_FULLSCREEN);
 			break;
-		case KEY_MAXVERT:
+		case ACTION_MAXVERT:
 			if (e->state & altmask) {
 				maximise_client(c, NET_WM_STATE_TOGGLE,
 					MAXIMISE_HORZ);
@@ -201,18 +291,19 @@ handle_key_event(XKeyEvent * e)
 					MAXIMISE_VERT);
 			}
 			break;
-		case KEY_FIX:
+		case ACTION_FIX:
 			if (is_fixed(c)) {
 				client_to_vdesk(c, c->phy->vdesk);
 			} else {
 				client_to_vdesk(c, VDESK_FIXED);
 			}
 			break;
+		case ACTION_KILL:
+			send_wm_delete(c, e->state & altmask);
+			break;
 		default:
 			break;
 	}
-	if (key == KEY_KILL)
-		send_wm_delete(c, e->state & altmask);
 	if (move_client != true)
 		return;
 	if (abs(c->nx) == c->border && c->oldw != 0)
@@ -233,8 +324,18 @@ handle_key_event(XKeyEvent * e)
 static void
 handle_button_event(XButtonEvent * e)
 {
-	struct client     *c = find_client(e->window);
+	struct client     *c;
 
+	if (find_screen(e->window)) {
+		/* Our passive grab on the root window.  The pointer is frozen:
+		 * if the press wasn't over a frame, let it through to whatever
+		 * it was over as though we'd never grabbed it. */
+		c = find_client(e->subwindow);
+		XAllowEvents(dpy, c ? AsyncPointer : ReplayPointer, e->time);
+	} else {
+		/* A click on a frame border */
+		c = find_client(e->window);
+	}
 	if (c) {
 		switch (e->button) {
 			case Button1:
@@ -338,14 +439,107 @@ do_window_changes(int value_mask, XWindowChanges * wc, struct client * c, int gr
 		client_calc_cog(c);
 		client_calc_phy(c);
 	}
-	wc->x = client_to_Xcoord(c, x) - c->border;
-	wc->y = client_to_Xcoord(c, y) - c->border;
-	wc->border_width = c->border;
-	XConfigureWindow(dpy, c->parent, value_mask, wc);
-	XMoveResizeWindow(dpy, c->window, 0, 0, c->width, c->height);
-	if ((value_mask & (CWX | CWY)) && !(value_mask & (CWWidth | CWHeight))) {
+	bool        notified = client_commit_geometry(c);
+
+	if (value_mask & CWStackMode) {
+		XConfigureWindow(dpy, c->parent,
+			value_mask & (CWSibling | CWStackMode), wc);
+	}
+	/* A move request gets a reply even if the position didn't change */
+	if ((value_mask & (CWX | CWY)) && !(value_mask & (CWWidth | CWHeight))
+		&& !notified) {
 		send_config(c);
 	}
+	occlusion_touch(c);
+	spatial_update(c);
+}
+
+/* Would this request leave the client as it is? */
+static int
+configure_is_noop(XConfigureRequestEvent * e, struct client * c)
+{
+	if (e->value_mask & (CWSibling | CWStackMode))
+		return 0;
+	if ((e->value_mask & CWX) && e->x != client_to_Xcoord(c, x))
+		return 0;
+	if ((e->value_mask & CWY) && e->y != client_to_Xcoord(c, y))
+		return 0;
+	if ((e->value_mask & CWWidth) && e->width != c->width)
+		return 0;
+	if ((e->value_mask & CWHeight) && e->height != c->height)
+		return 0;
+	/* border width requests are always overridden */
+	return 1;
+}
+
+/* Token bucket: may the client make another change now? */
+static int
+configure_allowed(struct client * c)
+{
+	long long   now = monotonic_msec();
+
+	c->configure_tokens += (now - c->configure_refilled) * CONFIGURE_RATE;
+	if (c->configure_tokens > CONFIGURE_BURST * 1000)
+		c->configure_tokens = CONFIGURE_BURST * 1000;
+	c->configure_refilled = now;
+	if (c->configure_tokens < 1000)
+		return 0;
+	c->configure_tokens -= 1000;
+	return 1;
+}
+
+static void configure_retry(void);
+static struct timer configure_timer = {.func = configure_retry };
+
+/* Make the changes @c has asked for and not yet had */
+static void
+configure_apply(struct client * c)
+{
+	XWindowChanges wc = c->configure_wc;
+	unsigned long value_mask = c->configure_mask;
+
+	c->configure_mask = 0;
+	if (value_mask & CWStackMode && value_mask & CWSibling) {
+		struct client     *sibling = find_client(wc.sibling);
+
+		if (sibling) {
+			wc.sibling = sibling->parent;
+		}
+	}
+	do_window_changes(value_mask, &wc, c, 0);
+	if (c == current) {
+		discard_enter_events(c);
+	}
+}
+
+/* Wake up once the bucket of @c holds a whole token again */
+static void
+configure_defer(struct client * c)
+{
+	long        msec = (1000 - c->configure_tokens + CONFIGURE_RATE - 1)
+		/ CONFIGURE_RATE;
+
+	if (!configure_timer.active
+		|| configure_timer.when > monotonic_msec() + msec)
+		timer_schedule(&configure_timer, msec);
+}
+
+/* Timer: make refused changes that clients may now have */
+static void
+configure_retry(void)
+{
+	struct list *iter;
+
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+
+		if (!c->configure_mask || c->remove)
+			continue;
+		if (configure_allowed(c))
+			configure_apply(c);
+		else
+			configure_defer(c);
+	}
 }
 
 static void
@@ -362,17 +556,42 @@ handle_configure_request(XConfigureRequestEvent * e)
 	wc.sibling = e->above;
 	wc.stack_mode = e->detail;
 	if (c) {
-		if (e->value_mask & CWStackMode && e->value_mask & CWSibling) {
-			struct client     *sibling = find_client(e->above);
-
-			if (sibling) {
-				wc.sibling = sibling->parent;
-			}
+		/* ICCCM 4.1.5: a request that isn't acted on is answered with
+		 * a synthetic ConfigureNotify of the current geometry */
+		if (!c->configure_mask && configure_is_noop(e, c)) {
+			stats.configure_noop++;
+			send_config(c);
+			return;
 		}
-		do_window_changes(e->value_mask, &wc, c, 0);
-		if (c == current) {
-			discard_enter_events(c);
+		/* Fold this request into any still waiting, so that the
+		 * latest value of each field is the one made */
+		if (e->value_mask & CWX)
+			c->configure_wc.x = wc.x;
+		if (e->value_mask & CWY)
+			c->configure_wc.y = wc.y;
+		if (e->value_mask & CWWidth)
+			c->configure_wc.width = wc.width;
+		if (e->value_mask & CWHeight)
+			c->configure_wc.height = wc.height;
+		if (e->value_mask & CWSibling)
+			c->configure_wc.sibling = wc.sibling;
+		if (e->value_mask & CWStackMode)
+			c->configure_wc.stack_mode = wc.stack_mode;
+		c->configure_wc.border_width = 0;
+		c->configure_mask |= e->value_mask;
+		if (!configure_allowed(c)) {
+			/* Made later, from configure_retry() */
+			if (!c->configures_refused) {
+				LOG_DEBUG("window=%lx configuring too fast\n",
+					c->window);
+			}
+			c->configures_refused++;
+			stats.configure_refused++;
+			send_config(c);
+			configure_defer(c);
+			return;
 		}
+		configure_apply(c);
 	} else {
 		LOG_XENTER("XConfigureWindow(window=%lx, value_mask=%lx)",
 			(unsigned int) e->window, e->value_mask);
@@ -387,6 +606,14 @@ handle_map_request(XMapRequestEvent * e)
 	struct client     *c = find_client(e->window);
 
 	LOG_ENTER("handle_map_request(window=%lx)", e->window);
+	if (c && c->remove) {
+		/* Withdrawn earlier in this batch and mapped again: release it
+		 * now, so it is adopted afresh rather than shown and then
+		 * released from under the new mapping. */
+		LOG_DEBUG("remapped while queued for removal\n");
+		remove_queued_clients();
+		c = NULL;
+	}
 	if (c) {
 		if (!is_fixed(c) && c->vdesk != c->phy->vdesk)
 			switch_vdesk(c->screen, c->phy, c->vdesk);
@@ -395,8 +622,12 @@ handle_map_request(XMapRequestEvent * e)
 	} else {
 		XWindowAttributes attr;
 
+		struct screen_info *s;
+
 		XGetWindowAttributes(dpy, e->window, &attr);
-		make_new_client(e->window, find_screen(attr.root));
+		s = find_screen(attr.root);
+		if (!spare_claim(e->window, s))
+			make_new_client(e->window, s);
 	}
 	LOG_LEAVE();
 }
@@ -414,8 +645,7 @@ handle_unmap_event(XUnmapEvent * e)
 				c->ignore_unmap);
 		} else {
 			LOG_DEBUG("flagging client for removal\n");
-			c->remove = 1;
-			need_client_tidy = 1;
+			queue_remove_client(c);
 		}
 	} else {
 		LOG_DEBUG("unknown client!\n");
@@ -442,11 +672,14 @@ handle_property_change(XPropertyEvent * e)
 	if (c) {
 		LOG_ENTER("handle_property_change(window=%lx, atom=%s)",
 			e->window, debug_atom_name(e->atom));
+		props_update(c, e->atom);
 		if (e->atom == XA_WM_NORMAL_HINTS) {
 			get_wm_normal_hints(c);
 			LOG_DEBUG("geometry=%dx%d\n", c->width, c->height);
 		} else if (e->atom == xa_net_wm_window_type) {
 			get_window_type(c);
+			/* docks are in no MRU list */
+			mru_update(c);
 			if (!c->is_dock && (is_fixed(c)
 					|| (c->vdesk == c->phy->vdesk))) {
 				client_show(c);
@@ -456,17 +689,78 @@ handle_property_change(XPropertyEvent * e)
 	}
 }
 
+/*
+ * With -focusdelay, entering a window only focuses it once the pointer
+ * has stayed there that long, so sweeping across windows doesn't focus
+ * each one in passing.  Any explicit selection (a click, Alt+Tab, a new
+ * window) cancels a pending focus change.
+ */
+
+int         opt_focus_delay = 0;
+static struct client *focus_pending = NULL;
+static void focus_settle(void);
+static struct timer focus_timer = {.func = focus_settle };
+
+static void
+focus_settle(void)
+{
+	struct client     *c = focus_pending;
+	Window      root, child;
+	int         x, y, wx, wy;
+	unsigned int mask;
+
+	focus_pending = NULL;
+	if (!c || (!is_fixed(c) && c->vdesk != c->phy->vdesk))
+		return;
+	/* The pointer may have moved on to a window we don't manage, which
+	 * tells us nothing; check it is still over this client's frame */
+	if (!XQueryPointer(dpy, c->screen->root, &root, &child, &x, &y,
+			&wx, &wy, &mask)
+		|| spatial_client_at(c->screen, c->phy->vdesk, x, y) != c)
+		return;
+	select_client(c);
+	ewmh_select_client(c);
+}
+
+void
+focus_cancel(void)
+{
+	focus_pending = NULL;
+	timer_cancel(&focus_timer);
+}
+
+/* Called as a client is released */
+void
+focus_client_removed(struct client * c)
+{
+	if (focus_pending == c)
+		focus_cancel();
+}
+
 static void
 handle_enter_event(XCrossingEvent * e)
 {
-	struct client     *c;
+	struct client     *c = find_client(e->window);
 
-	if ((c = find_client(e->window))) {
-		if (!is_fixed(c) && c->vdesk != c->phy->vdesk)
-			return;
-		select_client(c);
-		ewmh_select_client(c);
+	/* The pointer has gone to the root window (of this screen or
+	 * another) or a window that won't be focused: forget any window it
+	 * passed over on the way */
+	if (!c || (!is_fixed(c) && c->vdesk != c->phy->vdesk)) {
+		if (focus_pending)
+			focus_cancel();
+		return;
 	}
+	if (opt_focus_delay > 0) {
+		if (c == current) {
+			focus_cancel();
+		} else {
+			focus_pending = c;
+			timer_schedule(&focus_timer, opt_focus_delay);
+		}
+		return;
+	}
+	select_client(c);
+	ewmh_select_client(c);
 }
 
 static void
@@ -476,6 +770,7 @@ handle_mappingnotify_event(XMappingEvent * e)
 	if (e->request == MappingKeyboard) {
 		int         i;
 
+		keys_build();
 		for (i = 0; i < num_screens; i++) {
 			grab_keys_for_screen(&screens[i]);
 		}
@@ -555,7 +850,7 @@ handle_client_message(XClientMessageEvent * e)
 		e->window, e->format, debug_atom_name(e->message_type));
 
 	if (e->message_type == xa_net_current_desktop) {
-		switch_vdesk(s, s->physical, e->data.l[0]);
+		defer_switch_vdesk(s, s->physical, e->data.l[0]);
 		LOG_LEAVE();
 		return;
 	}
@@ -650,6 +945,60 @@ handle_client_message(XClientMessageEvent * e)
 	LOG_LEAVE();
 }
 
+/* The window an event is about, for accounting.  For events reported
+ * through SubstructureRedirect/Notify that is not xany.window, which is
+ * the parent. */
+static Window
+event_subject(XEvent * ev)
+{
+	switch (ev->type) {
+		case ConfigureRequest:
+			return ev->xconfigurerequest.window;
+		case MapRequest:
+			return ev->xmaprequest.window;
+		case UnmapNotify:
+			return ev->xunmap.window;
+		case DestroyNotify:
+			return ev->xdestroywindow.window;
+		case ButtonPress:
+			if (find_screen(ev->xbutton.window))
+				return ev->xbutton.subwindow;
+			return ev->xbutton.window;
+		default:
+			return ev->xany.window;
+	}
+}
+
+/* Is this an event whose vdesk switch may be folded into later ones?
+ * Releases of the switch keys count too: without detectable autorepeat, a
+ * held key repeats as release/press pairs. */
+static int
+is_vdesk_switch_event(XEvent * ev)
+{
+	if (ev->type == ClientMessage)
+		return ev->xclient.message_type == xa_net_current_desktop;
+	if (ev->type == KeyPress || ev->type == KeyRelease) {
+		unsigned    action = key_lookup(ev->xkey.keycode,
+			ev->xkey.state)->action;
+
+		return action == ACTION_VDESK || action == ACTION_PREVDESK
+			|| action == ACTION_NEXTDESK;
+	}
+	return 0;
+}
+
+/* Another window manager has taken WM_Sn from us (ICCCM 2.8) */
+static void
+handle_selection_clear(XSelectionClearEvent * e)
+{
+	for (int i = 0; i < num_screens; i++) {
+		if (e->window == screens[i].wm_selection_owner) {
+			LOG_DEBUG("lost WM_S%d, exiting\n", i);
+			wm_exit = 1;
+		}
+	}
+}
+
 void
 event_main_loop(void)
 {
@@ -667,6 +1016,14 @@ event_main_loop(void)
 	/* main event loop here */
 	while (!wm_exit) {
 		if (interruptibleXNextEvent(&ev.xevent)) {
+			/* Anything other than another vdesk switch sees the
+			 * result of those already requested. */
+			if (vdesk_switch_pending
+				&& !is_vdesk_switch_event(&ev.xevent))
+				commit_vdesk_switches();
+			Window      subject = event_subject(&ev.xevent);
+			unsigned long request = NextRequest(dpy);
+
 			switch (ev.xevent.type) {
 				case KeyPress:
 					handle_key_event(&ev.xevent.xkey);
@@ -706,7 +1063,16 @@ event_main_loop(void)
 					handle_client_message(&ev.xevent.
 						xclient);
 					break;
+				case SelectionClear:
+					handle_selection_clear(&ev.xevent.
+						xselectionclear);
+					break;
 				default:
+					if (have_xkb
+						&& ev.xevent.type ==
+						xkb_event_base) {
+						handle_xkb_event(&ev.xevent);
+					}
 #ifdef SHAPE
 					if (have_shape
 						&& ev.xevent.type ==
@@ -724,20 +1090,83 @@ event_main_loop(void)
 #endif
 					break;
 			}
+			stats_account(subject, &ev.xevent,
+				NextRequest(dpy) - request);
+		}
+		if (removal_queue_full() || !XPending(dpy))
+			remove_queued_clients();
+		run_timers();
+		/* End of this batch of events */
+		if ((vdesk_switch_pending || occlusion_pending)
+			&& !XPending(dpy)) {
+			commit_vdesk_switches();
+			occlusion_update();
 		}
-		if (need_client_tidy) {
-			struct list *iter, *niter;
+		if (stats_dump_requested) {
+			stats_dump_requested = 0;
+			stats_dump();
+		}
+		if (reload_requested) {
+			reload_requested = 0;
+			reload_config();
+		}
+		if (child_exited) {
+			child_exited = 0;
+			reap_children();
+		}
+	}
+}
 
-			need_client_tidy = 0;
-			for (iter = clients_tab_order; iter; iter = niter) {
-				struct client     *c = iter->data;
+/** timer_schedule:
+ *  Arrange for @t->func to be called from the event loop @msec
+ *  milliseconds from now.  Rescheduling an active timer moves it.
+ */
+void
+timer_schedule(struct timer * t, long msec)
+{
+	struct timer **tp;
 
-				niter = iter->next;
-				if (c->remove)
-					remove_client(c);
-			}
+	timer_cancel(t);
+	t->when = monotonic_msec() + msec;
+	for (tp = &timers; *tp && (*tp)->when <= t->when; tp = &(*tp)->next)
+		;
+	t->next = *tp;
+	*tp = t;
+	t->active = 1;
+}
+
+void
+timer_cancel(struct timer * t)
+{
+	struct timer **tp;
+
+	if (!t->active)
+		return;
+	for (tp = &timers; *tp; tp = &(*tp)->next) {
+		if (*tp == t) {
+			*tp = t->next;
+			break;
 		}
 	}
+	t->active = 0;
+}
+
+/* Call the handlers of any timers that have expired */
+static void
+run_timers(void)
+{
+	long long   now;
+
+	if (!timers)
+		return;
+	now = monotonic_msec();
+	while (timers && timers->when <= now) {
+		struct timer *t = timers;
+
+		timers = t->next;
+		t->active = 0;
+		t->func();
+	}
 }
 
 /* interruptibleXNextEvent() is taken from the Blender source and comes with
@@ -750,7 +1179,7 @@ event_main_loop(void)
  * implied. This program is -not- in the public domain. */
 
 /* Unlike XNextEvent, if a signal arrives, interruptibleXNextEvent will
- * return zero. */
+ * return zero.  It also returns zero when the next timer is due. */
 
 static int
 interruptibleXNextEvent(XEvent * event)
@@ -760,13 +1189,26 @@ interruptibleXNextEvent(XEvent * event)
 	int         dpy_fd = ConnectionNumber(dpy);
 
 	for (;;) {
+		struct timeval tv, *tvp = NULL;
+
 		if (XPending(dpy)) {
 			XNextEvent(dpy, event);
 			return 1;
 		}
+		if (timers) {
+			long long   wait = timers->when - monotonic_msec();
+
+			if (wait <= 0)
+				return 0;
+			tv.tv_sec = wait / 1000;
+			tv.tv_usec = (wait % 1000) * 1000;
+			tvp = &tv;
+		}
 		FD_ZERO(&fds);
 		FD_SET(dpy_fd, &fds);
-		rc = select(dpy_fd + 1, &fds, NULL, NULL, NULL);
+		rc = select(dpy_fd + 1, &fds, NULL, NULL, tvp);
+		if (rc == 0)
+			return 0;
 		if (rc < 0) {
 			if (errno == EINTR) {
 				return 0;
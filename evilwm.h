@@ -17,6 +17,9 @@
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif
+#ifdef XRES
+#include <X11/extensions/XRes.h>
+#endif
 
 #include <stdbool.h>
 
@@ -64,12 +67,24 @@ typedef struct
 
 /* readability stuff */
 
+/* Geometry changing ConfigureRequests each client may make: a sustained
+ * rate per second, and a burst allowance */
+#define CONFIGURE_RATE  30
+#define CONFIGURE_BURST 60
+
+/* Withdrawn clients wait to be released together until the event queue is
+ * drained, or until this many are waiting */
+#define REMOVAL_BATCH_MAX 32
+
 #define VDESK_INVALID (0xfffffffd)
 #define VDESK_NONE  (0xfffffffe)
 #define VDESK_FIXED (0xffffffff)
 #define VDESK_MAX   (opt_vdesks - 1)
 #define KEY_TO_VDESK(key) (((key) - XK_1 + 10) % 10)
 #define valid_vdesk(v) ((v) == VDESK_FIXED || (v) < opt_vdesks)
+/* vdesk a physical screen shows once deferred switches are committed */
+#define effective_vdesk(p) ((p)->pending_vdesk != VDESK_INVALID ? \
+		(p)->pending_vdesk : (p)->vdesk)
 
 #define RAISE           1
 #define NO_RAISE        0	/* for unhide() */
@@ -97,18 +112,6 @@ typedef struct
 #define grab_pointer(w, mask, curs) \
 	(XGrabPointer(dpy, w, False, mask, GrabModeAsync, GrabModeAsync, \
 	None, curs, CurrentTime) == GrabSuccess)
-#define grab_button(w, mask, button) do { \
-		XGrabButton(dpy, button, (mask), w, False, ButtonMask, \
-		            GrabModeAsync, GrabModeSync, None, None); \
-		XGrabButton(dpy, button, LockMask|(mask), w, False, ButtonMask,\
-		            GrabModeAsync, GrabModeSync, None, None); \
-		XGrabButton(dpy, button, numlockmask|(mask), w, False, \
-		            ButtonMask, GrabModeAsync, GrabModeSync, \
-		            None, None); \
-		XGrabButton(dpy, button, numlockmask|LockMask|(mask), w, False,\
-		            ButtonMask, GrabModeAsync, GrabModeSync, \
-		            None, None); \
-	} while (0)
 #define setmouse(w, x, y) XWarpPointer(dpy, None, w, 0, 0, 0, 0, x, y)
 #define get_mouse_position(xp,yp,root) do { \
 		Window dw; \
@@ -132,6 +135,7 @@ struct physical_screen
 	int         width;	/* width of the screen */
 	int         height;	/* height of the screen */
 	unsigned int vdesk;	/* virtual desktop displayed on this physical screen */
+	unsigned int pending_vdesk;	/* deferred switch target, or VDESK_INVALID */
 };
 
 struct screen_info
@@ -139,6 +143,7 @@ struct screen_info
 	int         screen;
 	Window      root;
 	Window      supporting;	/* Dummy window for EWMH */
+	Window      wm_selection_owner;	/* Owns WM_Sn (ICCCM 2.8) */
 	GC          invert_gc;
 	XColor      fg, bg;
 	XColor      fc;
@@ -148,6 +153,9 @@ struct screen_info
 
 	int         num_physical;	/* Number of entries in @physical@ */
 	struct physical_screen *physical;	/* Physical screens that make up this screen */
+
+	/* Focus history heads, by vdesk; [opt_vdesks] is for fixed clients */
+	struct client **mru;
 };
 
 /* client structure */
@@ -176,6 +184,67 @@ struct client
 	unsigned int vdesk;
 	int         is_dock;
 	int         remove;	/* set when client needs to be removed */
+
+	int         mapped;	/* frame is mapped */
+	int         hidden;	/* _NET_WM_STATE_HIDDEN is set */
+	int         shaped;	/* window has a bounding shape */
+	int         occlusion_dirty;
+	XRectangle  occlusion_rect;	/* frame as of last occlusion check */
+	struct spatial_index *spatial;	/* index the client's edges are in */
+	XRectangle  spatial_rect;	/* window as filed in that index */
+	long        stack_stamp;	/* higher is higher in stacking order */
+
+	/* Focus history, see mru.c */
+	struct client **mru_list;	/* head of the list it is in, or NULL */
+	struct client *mru_prev, *mru_next;
+	unsigned long mru_stamp;	/* when last selected or refiled */
+
+	/* Property cache, see props.c */
+	int         has_wm_delete;	/* WM_PROTOCOLS has WM_DELETE_WINDOW */
+	char       *name;	/* _NET_WM_NAME or WM_NAME */
+	char       *res_name, *res_class;	/* WM_CLASS */
+	unsigned int window_type;	/* EWMH_WINDOW_TYPE_* */
+	XSizeHints  normal_hints;	/* WM_NORMAL_HINTS */
+	PropMwmHints mwm_hints;	/* _MOTIF_WM_HINTS; flags 0 if unset */
+
+	pid_t       pid;	/* local process owning window, or 0 */
+	long long   unmapped_since;	/* monotonic_msec() when hidden, or 0 */
+
+	/* Geometry as last sent to the server, see client_commit_geometry() */
+	struct
+	{
+		int         x, y, width, height, border;	/* frame */
+		int         win_width, win_height;	/* client window */
+		int         config_x, config_y;	/* last synthetic ConfigureNotify */
+	} sent;
+
+	/* ConfigureRequest rate limiting, see handle_configure_request() */
+	long        configure_tokens;	/* thousandths of a request */
+	long long   configure_refilled;	/* monotonic_msec() of last refill */
+	unsigned long configures_refused;
+	unsigned long configure_mask;	/* refused changes not yet made, or 0 */
+	XWindowChanges configure_wc;	/* ... and their values */
+
+	/* Events received and requests made on the client's behalf, see
+	 * stats_account() */
+	struct
+	{
+		long long   since;	/* monotonic_msec() when adopted */
+		unsigned long configure_requests;
+		unsigned long property_notifies;
+		unsigned long client_messages;
+		unsigned long shape_notifies;
+		unsigned long other_events;
+		unsigned long requests;
+		struct atom_count *atoms;	/* PropertyNotify by atom */
+		int         num_atoms;
+	} acct;
+};
+
+struct atom_count
+{
+	Atom        atom;
+	unsigned long count;
 };
 
 struct application
@@ -189,6 +258,35 @@ struct application
 	unsigned int vdesk;
 };
 
+/* Runtime counters, see stats.c */
+struct stats
+{
+	unsigned long vdesk_switches;
+	unsigned long vdesk_switches_coalesced;
+	unsigned long vdesk_unmapped;
+	unsigned long vdesk_mapped;
+	unsigned long vdesk_exposed;	/* mapped frames left (partly) uncovered */
+	struct
+	{
+		unsigned int unmapped, mapped, exposed;
+	} last_switch;
+	unsigned long occlusion_checks;
+	unsigned long occlusion_changes;
+	unsigned long pids_frozen;
+	unsigned long pids_thawed;
+	unsigned long pids_boosted;
+	unsigned long key_repeats_folded;
+	unsigned long geometry_sent;	/* configure requests issued */
+	unsigned long geometry_suppressed;	/* ... and found unnecessary */
+	unsigned long config_notify_sent;
+	unsigned long config_notify_suppressed;
+	unsigned long configure_noop;	/* ConfigureRequests changing nothing */
+	unsigned long configure_refused;	/* ... and refused by rate limit */
+	unsigned long reloads;	/* SIGHUP config reloads */
+	long long   last_reload_msec;	/* ... time taken by the last */
+	long long   handover_msec;	/* waiting for a -replace'd WM to exit */
+};
+
 /* Declarations for global variables in main.c */
 
 /* Commonly used X information */
@@ -208,6 +306,9 @@ extern int  have_randr, randr_event_base;
 #ifdef XINERAMA
 extern int  have_xinerama;
 #endif
+#ifdef XRES
+extern int  have_xres;
+#endif
 
 /* Standard X protocol atoms */
 extern Atom xa_wm_state;
@@ -224,6 +325,7 @@ extern Atom mwm_hints;
 extern Atom xa_evilwm_unmaximised_horz;
 extern Atom xa_evilwm_unmaximised_vert;
 extern Atom xa_evilwm_current_desktops;
+extern Atom xa_evilwm_state;
 
 /* EWMH: Root Window Properties (and Related Messages) */
 extern Atom xa_net_current_desktop;
@@ -245,16 +347,20 @@ extern Atom xa_net_wm_state_maximized_vert;
 extern Atom xa_net_wm_state_maximized_horz;
 extern Atom xa_net_wm_state_fullscreen;
 extern Atom xa_net_frame_extents;
+extern Atom xa_net_wm_pid;
 
 /* Things that affect user interaction */
 extern unsigned int numlockmask;
 extern unsigned int grabmask1;
 extern unsigned int grabmask2;
 extern unsigned int altmask;
-extern KeySym opt_key_kill;
 extern char **opt_term;
 extern int  opt_bw;
 extern int  opt_snap;
+extern int  opt_smartplace;
+extern int  opt_freeze;
+extern const char *opt_cgroup_root;
+extern int  opt_cgroup_weight;
 
 #ifdef SOLIDDRAG
 extern int  no_solid_drag;
@@ -266,6 +372,7 @@ extern unsigned int opt_vdesks;	/* number of virtual desktops to use */
 
 /* struct client tracking information */
 extern struct list *clients_tab_order;
+extern XContext client_context;
 extern struct list *clients_mapping_order;
 extern struct list *clients_stacking_order;
 extern struct client *current;
@@ -273,6 +380,17 @@ extern volatile Window initialising;
 
 /* Event loop will run until this flag is set */
 extern int  wm_exit;
+/* Set by SIGHUP; the event loop then calls reload_config() */
+extern int  reload_requested;
+/* Set by SIGUSR2, along with wm_exit: exec in place, see restart.c */
+extern int  restart_requested;
+
+void        reload_config(void);
+
+/* apps.c */
+
+void        apps_compile(void);
+int         apps_apply(struct client * c);
 
 /* client.c */
 #define client_to_Xcoord(c,T) (c->phy-> T ## off + c-> n ## T)
@@ -282,12 +400,17 @@ void        client_hide(struct client * c);
 void        client_show(struct client * c);
 void        client_raise(struct client * c);
 void        client_lower(struct client * c);
+void        client_stacked_top(struct client * c);
 void        client_update_screenpos(struct client * c, int screen_x, int screen_y);
 void        gravitate_border(struct client * c, int bw);
 void        select_client(struct client * c);
 void        client_to_vdesk(struct client * c, unsigned int vdesk);
-void        remove_client(struct client * c);
+void        queue_remove_client(struct client * c);
+void        remove_queued_clients(void);
+bool        removal_queue_full(void);
+void        remove_all_clients(void);
 void        send_config(struct client * c);
+bool        client_commit_geometry(struct client * c);
 void        send_wm_delete(struct client * c, int kill_client);
 void        set_wm_state(struct client * c, int state);
 void        set_shape(struct client * c);
@@ -298,23 +421,92 @@ void        client_calc_phy(struct client * c);
 
 /* events.c */
 
+/* Called from the event loop once @when (monotonic_msec() time) passes */
+struct timer
+{
+	struct timer *next;
+	long long   when;
+	void        (*func) (void);
+	int         active;
+};
+
 void        event_main_loop(void);
+void        timer_schedule(struct timer * t, long msec);
+void        timer_cancel(struct timer * t);
+
+extern int  opt_focus_delay;	/* msec before entering a window focuses it */
+void        focus_cancel(void);
+void        focus_client_removed(struct client * c);
 
 /* misc.c */
 
-extern int  need_client_tidy;
 extern int  ignore_xerror;
+extern int  child_exited;	/* set by SIGCHLD */
 int         handle_xerror(Display * dsply, XErrorEvent * e);
-void        spawn(const char *const cmd[]);
+pid_t       spawn(const char *const cmd[]);
+void        reap_children(void);
+long long   monotonic_msec(void);
 void        handle_signal(int signo);
 void        discard_enter_events(struct client * except);
 
 /* new.c */
 
 void        make_new_client(Window w, struct screen_info * s);
+void        init_client(struct client * c, Window w, struct screen_info * s);
+void        adopt_frame(struct client * c, Window parent);
 long        get_wm_normal_hints(struct client * c);
 void        get_window_type(struct client * c);
 
+/* process.c */
+
+pid_t       window_get_net_wm_pid(Window w);
+pid_t       window_get_pid(Window w);
+pid_t       client_get_pid(struct client * c);
+void        freeze_client_hidden(struct client * c);
+void        freeze_client_shown(struct client * c);
+void        freeze_client_removed(struct client * c);
+void        freeze_thaw_all(void);
+void        freeze_dump_stats(void);
+void        boost_client_focused(struct client * c);
+void        boost_release(void);
+void        boost_dump_stats(void);
+
+/* place.c */
+
+void        place_client(struct client * c);
+
+/* prompt.c */
+
+#define PROMPT_LINES    10	/* matches shown */
+#define PROMPT_MAX_TEXT 256
+#define PROMPT_CANCEL   (-1)
+#define PROMPT_TEXT     (-2)
+
+struct prompt
+{
+	const char *label;
+	/* Store up to @max ids of items matching @text in @results, best
+	 * first, and return how many */
+	int         (*match) (const char *text, int *results, int max);
+	/* The text shown for an item */
+	const char *(*item) (int id);
+};
+
+int         prompt_run(const struct prompt *p, char *text, size_t size);
+
+/* props.c */
+
+void        props_fetch(struct client * c);
+int         props_update(struct client * c, Atom atom);
+int         props_want_border(struct client * c);
+void        props_free(struct client * c);
+
+/* restart.c */
+
+void        restart_save_state(void);
+void        restart_abandon(const char *display);
+void        restart_restore_state(struct screen_info * s);
+
 /* screen.c */
 
 void        drag(struct client * c);
@@ -326,6 +518,9 @@ void        show_info(struct client * c, unsigned int keycode);
 void        sweep(struct client * c);
 void        next(void);
 bool        switch_vdesk(struct screen_info * s, struct physical_screen * p, unsigned int v);
+extern int  vdesk_switch_pending;
+bool        defer_switch_vdesk(struct screen_info * s, struct physical_screen * p, unsigned int v);
+void        commit_vdesk_switches(void);
 void        exchange_phy(struct screen_info * s);
 void        set_docks_visible(struct screen_info * s, int is_visible);
 struct screen_info *find_screen(Window root);
@@ -333,9 +528,55 @@ struct screen_info *find_current_screen(void);
 void        find_current_screen_and_phy(struct screen_info ** current_screen,
 	struct physical_screen ** current_phy);
 struct physical_screen *find_physical_screen(struct screen_info * screen, int x, int y);
-void        grab_keys_for_screen(struct screen_info * s);
 void        probe_screen(struct screen_info * s);
 
+/* trigram.c */
+
+struct trigram_posting;
+
+struct trigram_index
+{
+	char      **keys;	/* lower-cased copy of each string */
+	int        *sorted;	/* ids in order of key */
+	struct trigram_posting *postings;
+	int         nkeys, npostings;
+};
+
+int         trigram_build(struct trigram_index * t, const char *const *strings, int n);
+void        trigram_free(struct trigram_index * t);
+int         trigram_search(const struct trigram_index * t, const char *query,
+	int *results, int max);
+
+/* mru.c */
+
+void        mru_touch(struct client * c);
+void        mru_update(struct client * c);
+void        mru_remove(struct client * c);
+struct client *mru_cycle_next(void);
+void        mru_cycle_end(void);
+
+/* finder.c */
+
+void        finder_invalidate(void);
+void        finder_run(void);
+
+/* launcher.c */
+
+#ifdef LAUNCHER
+void        launcher_init(void);
+void        launcher_run(void);
+#endif
+
+/* spare.c */
+
+extern int  opt_hotspare;
+
+void        spare_start(void);
+int         spare_claim(Window w, struct screen_info * s);
+void        spawn_terminal(void);
+void        spare_reaped(pid_t pid);
+void        spare_discard(void);
+
 /* ewmh.c */
 
 void        ewmh_init(void);
@@ -365,6 +606,7 @@ void        annotate_create(struct client * c, struct annotate_ctx *a);
 void        annotate_preupdate(struct client * c, struct annotate_ctx *a);
 void        annotate_update(struct client * c, struct annotate_ctx *a);
 void        annotate_remove(struct client * c, struct annotate_ctx *a);
+void        annotate_reset(void);
 void        set_annotate_info_outline(const char *arg);
 void        set_annotate_info_info(const char *arg);
 void        set_annotate_info_cog(const char *arg);
@@ -375,7 +617,74 @@ void        set_annotate_sweep_outline(const char *arg);
 void        set_annotate_sweep_info(const char *arg);
 void        set_annotate_sweep_cog(const char *arg);
 
+/* keys.c */
+
+enum key_action
+{
+	ACTION_NONE = 0,
+	ACTION_NEW, ACTION_NEXT, ACTION_DOCK_TOGGLE,
+	ACTION_VDESK, ACTION_PREVDESK, ACTION_NEXTDESK, ACTION_TOGGLEDESK,
+	ACTION_EXGPHY, ACTION_FIX,
+	ACTION_LEFT, ACTION_RIGHT, ACTION_DOWN, ACTION_UP,
+	ACTION_TOPLEFT, ACTION_TOPRIGHT, ACTION_BOTTOMLEFT, ACTION_BOTTOMRIGHT,
+	ACTION_LOWER, ACTION_ALTLOWER, ACTION_INFO,
+	ACTION_MAXVERT, ACTION_MAX, ACTION_FULLSCREEN, ACTION_KILL,
+	ACTION_LAUNCH, ACTION_FIND,
+	NUM_KEY_ACTIONS
+};
+
+struct key_binding
+{
+	unsigned char action;
+	unsigned char arg;	/* vdesk for ACTION_VDESK */
+};
+
+extern int  have_xkb;
+extern int  xkb_event_base;
+extern char *opt_key[NUM_KEY_ACTIONS];
+void        keys_init(void);
+void        keys_build(void);
+const struct key_binding *key_lookup(unsigned int keycode, unsigned int state);
+void        grab_keys_for_screen(struct screen_info * s);
+void        grab_buttons_for_screen(struct screen_info * s);
+void        handle_xkb_event(XEvent * e);
+
+/* occlusion.c */
+
+extern int  occlusion_pending;
+void        occlusion_touch(struct client * c);
+void        occlusion_forget(struct client * c);
+void        occlusion_update(void);
+
+/* spatial.c */
+
+void        spatial_update(struct client * c);
+void        spatial_remove(struct client * c);
+void        spatial_near_edges(struct screen_info * s, unsigned int vdesk,
+	const int x[2], const int y[2], int dist, int border,
+	void (*func) (struct client *, void *), void *data);
+struct client *spatial_client_at(struct screen_info * s, unsigned int vdesk,
+	int x, int y);
+
+/* stats.c */
+
+extern struct stats stats;
+extern int  stats_dump_requested;
+void        stats_dump(void);
+void        stats_account(Window w, XEvent * ev, unsigned long requests);
+
 /* defines */
+
+/* Frame geometry (including border) in screen co-ordinates */
+static inline void
+client_frame_rect(struct client * c, XRectangle * r)
+{
+	r->x = client_to_Xcoord(c, x) - c->border;
+	r->y = client_to_Xcoord(c, y) - c->border;
+	r->width = c->width + 2 * c->border;
+	r->height = c->height + 2 * c->border;
+}
+
 static inline int
 should_be_mapped(struct client * c)
 {
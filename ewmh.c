@@ -22,6 +22,7 @@ Atom        mwm_hints;
 Atom        xa_evilwm_unmaximised_horz;
 Atom        xa_evilwm_unmaximised_vert;
 Atom        xa_evilwm_current_desktops;
+Atom        xa_evilwm_state;
 
 /* Root Window Properties (and Related Messages) */
 static Atom xa_net_supported;
@@ -60,7 +61,7 @@ static Atom xa_net_wm_action_maximize_vert;
 static Atom xa_net_wm_action_fullscreen;
 static Atom xa_net_wm_action_change_desktop;
 static Atom xa_net_wm_action_close;
-static Atom xa_net_wm_pid;
+Atom        xa_net_wm_pid;
 Atom        xa_net_frame_extents;
 
 /* Maintain a reasonably sized allocated block of memory for lists
@@ -85,6 +86,7 @@ ewmh_init(void)
 		XInternAtom(dpy, "_EVILWM_UNMAXIMISED_VERT", False);
 	xa_evilwm_current_desktops =
 		XInternAtom(dpy, "_EVILWM_CURRENT_DESKTOPS", False);
+	xa_evilwm_state = XInternAtom(dpy, "_EVILWM_STATE", False);
 
 	/*
 	 * extended windowmanager hints
@@ -283,6 +285,11 @@ void
 ewmh_deinit_client(struct client * c)
 {
 	XDeleteProperty(dpy, c->window, xa_net_wm_allowed_actions);
+	/* Nothing will be tracking occlusion once we're gone */
+	if (c->hidden) {
+		c->hidden = 0;
+		ewmh_set_net_wm_state(c);
+	}
 }
 
 void
@@ -401,7 +408,7 @@ ewmh_get_net_wm_window_type(Window w)
 void
 ewmh_set_net_wm_state(struct client * c)
 {
-	Atom        state[3];
+	Atom        state[4];
 	int         i = 0;
 
 	if (c->oldh)
@@ -410,6 +417,8 @@ ewmh_set_net_wm_state(struct client * c)
 		state[i++] = xa_net_wm_state_maximized_horz;
 	if (c->oldh && c->oldw)
 		state[i++] = xa_net_wm_state_fullscreen;
+	if (c->hidden)
+		state[i++] = xa_net_wm_state_hidden;
 	XChangeProperty(dpy, c->window, xa_net_wm_state,
 		XA_ATOM, 32, PropModeReplace, (unsigned char *) &state, i);
 }
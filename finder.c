@@ -0,0 +1,177 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Finding a window by typing part of its class or title.
+ *
+ * Each client is listed as "class: title", using the names held in the
+ * property cache.  Both that label and the title alone are indexed, so
+ * that windows whose class or whose title starts with the text typed come
+ * first.  The cache tells us (finder_invalidate()) whenever a
+ * client is adopted or released or a PropertyNotify changes one of those
+ * names; the search index is only rebuilt, as the finder is opened, if
+ * that has happened since it was last built.
+ *
+ * Choosing a window switches its physical screen to its vdesk, then
+ * raises and focuses it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "evilwm.h"
+#include "log.h"
+
+static struct client **entries = NULL;
+static char **labels = NULL;
+static int  num_entries = 0;
+static struct trigram_index label_index;
+static int  index_dirty = 1;
+
+/* Called by the property cache when a client's names may have changed, or
+ * the set of clients has */
+void
+finder_invalidate(void)
+{
+	index_dirty = 1;
+}
+
+static void
+free_entries(void)
+{
+	for (int i = 0; i < num_entries; i++)
+		free(labels[i]);
+	free(labels);
+	free(entries);
+	labels = NULL;
+	entries = NULL;
+	num_entries = 0;
+	trigram_free(&label_index);
+}
+
+static char *
+make_label(struct client * c)
+{
+	const char *class = c->res_class ? c->res_class : c->res_name;
+	const char *name = c->name ? c->name : "Untitled";
+	size_t      size = (class ? strlen(class) + 2 : 0) + strlen(name) + 1;
+	char       *label = malloc(size);
+
+	if (label)
+		snprintf(label, size, "%s%s%s", class ? class : "",
+			class ? ": " : "", name);
+	return label;
+}
+
+/* Index keys per window: its label, then its title */
+#define KEYS_PER_ENTRY 2
+
+static void
+build_index(void)
+{
+	struct list *iter;
+	const char **keys;
+	int         n = 0;
+
+	free_entries();
+	index_dirty = 0;
+	for (iter = clients_tab_order; iter; iter = iter->next)
+		n++;
+	if (!n)
+		return;
+	entries = malloc(n * sizeof(struct client *));
+	labels = malloc(n * sizeof(char *));
+	if (!entries || !labels) {
+		free_entries();
+		return;
+	}
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+
+		/* withdrawn, but not yet released */
+		if (c->remove)
+			continue;
+		if (!(labels[num_entries] = make_label(c)))
+			break;
+		entries[num_entries++] = c;
+	}
+	if (!(keys = malloc(num_entries * KEYS_PER_ENTRY * sizeof(char *)))) {
+		free_entries();
+		return;
+	}
+	for (int i = 0; i < num_entries; i++) {
+		keys[i * KEYS_PER_ENTRY] = labels[i];
+		keys[i * KEYS_PER_ENTRY + 1] = entries[i]->name
+			? entries[i]->name : "Untitled";
+	}
+	if (!trigram_build(&label_index, keys, num_entries * KEYS_PER_ENTRY))
+		free_entries();
+	free(keys);
+	LOG_DEBUG("finder index: %d windows\n", num_entries);
+}
+
+/* Map matching keys to windows, each listed once, in order of first
+ * match */
+static int
+finder_match(const char *text, int *results, int max)
+{
+	int         keys[max * KEYS_PER_ENTRY];
+	int         nkeys, n = 0;
+
+	nkeys = trigram_search(&label_index, text, keys,
+		max * KEYS_PER_ENTRY);
+	for (int i = 0; i < nkeys && n < max; i++) {
+		int         id = keys[i] / KEYS_PER_ENTRY, j;
+
+		for (j = 0; j < n && results[j] != id; j++)
+			;
+		if (j == n)
+			results[n++] = id;
+	}
+	return n;
+}
+
+static const char *
+finder_item(int id)
+{
+	return labels[id];
+}
+
+static const struct prompt finder_prompt = {
+	.label = "window",
+	.match = finder_match,
+	.item = finder_item,
+};
+
+/** finder_run:
+ *  Prompt for a window and jump to it.
+ */
+void
+finder_run(void)
+{
+	char        text[PROMPT_MAX_TEXT];
+	struct client     *c;
+	int         id;
+
+	/* Windows withdrawn since the index was built are still listed */
+	for (int i = 0; i < num_entries && !index_dirty; i++) {
+		if (entries[i]->remove)
+			index_dirty = 1;
+	}
+	if (index_dirty)
+		build_index();
+	id = prompt_run(&finder_prompt, text, sizeof(text));
+	if (id < 0)
+		return;
+	c = entries[id];
+	if (!is_fixed(c) && c->vdesk != c->phy->vdesk)
+		switch_vdesk(c->screen, c->phy, c->vdesk);
+	client_show(c);
+	client_raise(c);
+	select_client(c);
+	ewmh_select_client(c);
+#ifdef WARP_POINTER
+	setmouse(c->window, c->width + c->border - 1,
+		c->height + c->border - 1);
+#endif
+	discard_enter_events(c);
+}
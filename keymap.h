@@ -23,6 +23,8 @@
 #define KEY_NEXTDESK   XK_Right
 #define KEY_TOGGLEDESK XK_a
 #define KEY_EXGPHY     XK_s
-#define KEY_KILL       opt_key_kill
+#define KEY_KILL       XK_Escape
+#define KEY_LAUNCH     XK_r
+#define KEY_FIND       XK_slash
 
 #endif
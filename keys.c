@@ -0,0 +1,261 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Key bindings.
+ *
+ * Bindings default to the keysyms in keymap.h and can be overridden with
+ * -key.<action> options.  They are resolved into a table indexed by
+ * keycode and by which of the grabbed modifier combinations (mask1,
+ * mask1+altmask or mask2) is held, so a key press is dispatched with two
+ * array lookups.  The table is rebuilt when the keyboard mapping changes.
+ *
+ * Rather than grabbing each key four times to cover every combination of
+ * Caps Lock and Num Lock, XKB (where available) tells us when the locked
+ * modifiers change and keys are grabbed with just the current ones. */
+
+#include <string.h>
+#include <X11/XKBlib.h>
+#include "evilwm.h"
+#include "log.h"
+
+int         have_xkb;
+int         xkb_event_base;
+
+/* Set from -key.<action> options; NULL means use the default */
+char       *opt_key[NUM_KEY_ACTIONS];
+
+/* Modifier combinations keys are grabbed with */
+enum
+{
+	ROW_NONE, ROW_MASK1, ROW_MASK1_ALT, ROW_MASK2, NUM_ROWS
+};
+
+#define R_MASK1     (1 << ROW_MASK1)
+#define R_MASK1_ALT (1 << ROW_MASK1_ALT)
+#define R_MASK2     (1 << ROW_MASK2)
+
+static const struct
+{
+	KeySym      keysym;
+	unsigned    rows;
+} key_defaults[NUM_KEY_ACTIONS] = {
+	[ACTION_NEW] = {KEY_NEW, R_MASK1},
+	[ACTION_NEXT] = {KEY_NEXT, R_MASK2},
+	[ACTION_DOCK_TOGGLE] = {KEY_DOCK_TOGGLE, R_MASK1},
+#ifdef VWM
+	[ACTION_PREVDESK] = {KEY_PREVDESK, R_MASK1},
+	[ACTION_NEXTDESK] = {KEY_NEXTDESK, R_MASK1},
+	[ACTION_TOGGLEDESK] = {KEY_TOGGLEDESK, R_MASK1},
+	[ACTION_EXGPHY] = {KEY_EXGPHY, R_MASK1},
+	[ACTION_FIX] = {KEY_FIX, R_MASK1},
+#endif
+	[ACTION_LEFT] = {KEY_LEFT, R_MASK1 | R_MASK1_ALT},
+	[ACTION_RIGHT] = {KEY_RIGHT, R_MASK1 | R_MASK1_ALT},
+	[ACTION_DOWN] = {KEY_DOWN, R_MASK1 | R_MASK1_ALT},
+	[ACTION_UP] = {KEY_UP, R_MASK1 | R_MASK1_ALT},
+	[ACTION_TOPLEFT] = {KEY_TOPLEFT, R_MASK1},
+	[ACTION_TOPRIGHT] = {KEY_TOPRIGHT, R_MASK1},
+	[ACTION_BOTTOMLEFT] = {KEY_BOTTOMLEFT, R_MASK1},
+	[ACTION_BOTTOMRIGHT] = {KEY_BOTTOMRIGHT, R_MASK1},
+	[ACTION_LOWER] = {KEY_LOWER, R_MASK1},
+	[ACTION_ALTLOWER] = {KEY_ALTLOWER, R_MASK1},
+	[ACTION_INFO] = {KEY_INFO, R_MASK1},
+	[ACTION_MAXVERT] = {KEY_MAXVERT, R_MASK1 | R_MASK1_ALT},
+	[ACTION_MAX] = {KEY_MAX, R_MASK1},
+	[ACTION_FULLSCREEN] = {KEY_FULLSCREEN, R_MASK1},
+	[ACTION_KILL] = {KEY_KILL, R_MASK1 | R_MASK1_ALT},
+	[ACTION_FIND] = {KEY_FIND, R_MASK1},
+#ifdef LAUNCHER
+	[ACTION_LAUNCH] = {KEY_LAUNCH, R_MASK1},
+#endif
+};
+
+/* key_table[keycode][row]; row ROW_NONE is always empty */
+static struct key_binding key_table[256][NUM_ROWS];
+/* Which row a (lock-stripped) modifier state selects */
+static unsigned char state_row[256];
+/* Lock modifiers keys are currently grabbed with (XKB only) */
+static unsigned int grab_locks;
+
+static void
+bind_keysym(KeySym keysym, unsigned rows, unsigned action, unsigned arg)
+{
+	KeyCode     keycode;
+
+	if (keysym == NoSymbol)
+		return;
+	keycode = XKeysymToKeycode(dpy, keysym);
+	if (!keycode)
+		return;
+	for (unsigned row = ROW_MASK1; row < NUM_ROWS; row++) {
+		if (rows & (1 << row)) {
+			key_table[keycode][row].action = action;
+			key_table[keycode][row].arg = arg;
+		}
+	}
+}
+
+/** keys_build:
+ *  (Re)build the key table from the current keyboard mapping, modifier
+ *  masks and binding options.
+ */
+void
+keys_build(void)
+{
+	unsigned    locks = LockMask | numlockmask;
+
+	memset(key_table, 0, sizeof(key_table));
+	for (unsigned s = 0; s < 256; s++) {
+		unsigned    m = s & ~locks;
+
+		if (m == grabmask1)
+			state_row[s] = ROW_MASK1;
+		else if (m == (grabmask1 | altmask))
+			state_row[s] = ROW_MASK1_ALT;
+		else if (m == grabmask2)
+			state_row[s] = ROW_MASK2;
+		else
+			state_row[s] = ROW_NONE;
+	}
+#ifdef VWM
+	for (KeySym k = XK_0; k <= XK_9; k++)
+		bind_keysym(k, R_MASK1, ACTION_VDESK, KEY_TO_VDESK(k));
+#endif
+	for (unsigned a = ACTION_NONE + 1; a < NUM_KEY_ACTIONS; a++) {
+		KeySym      keysym = key_defaults[a].keysym;
+
+		if (!key_defaults[a].rows)
+			continue;
+		if (opt_key[a]) {
+			keysym = XStringToKeysym(opt_key[a]);
+			if (keysym == NoSymbol) {
+				LOG_ERROR("unknown key: %s\n", opt_key[a]);
+			}
+		}
+		bind_keysym(keysym, key_defaults[a].rows, a, 0);
+	}
+}
+
+/** key_lookup:
+ *  Find the binding for a key press.  Unbound keys yield ACTION_NONE.
+ */
+const struct key_binding *
+key_lookup(unsigned int keycode, unsigned int state)
+{
+	return &key_table[keycode & 0xff][state_row[state & 0xff]];
+}
+
+static void
+grab_keycode(Window w, unsigned int mask, KeyCode keycode)
+{
+	if (have_xkb) {
+		XGrabKey(dpy, keycode, mask | grab_locks, w, True,
+			GrabModeAsync, GrabModeAsync);
+		return;
+	}
+	XGrabKey(dpy, keycode, mask, w, True, GrabModeAsync, GrabModeAsync);
+	XGrabKey(dpy, keycode, mask | LockMask, w, True,
+		GrabModeAsync, GrabModeAsync);
+	if (numlockmask) {
+		XGrabKey(dpy, keycode, mask | numlockmask, w, True,
+			GrabModeAsync, GrabModeAsync);
+		XGrabKey(dpy, keycode, mask | numlockmask | LockMask, w, True,
+			GrabModeAsync, GrabModeAsync);
+	}
+}
+
+void
+grab_keys_for_screen(struct screen_info * s)
+{
+	const unsigned int row_mask[NUM_ROWS] = {
+		[ROW_MASK1] = grabmask1,
+		[ROW_MASK1_ALT] = grabmask1 | altmask,
+		[ROW_MASK2] = grabmask2,
+	};
+
+	/* Release any previous grabs */
+	XUngrabKey(dpy, AnyKey, AnyModifier, s->root);
+	/* Grab key combinations we're interested in */
+	for (unsigned k = 0; k < 256; k++) {
+		for (unsigned row = ROW_MASK1; row < NUM_ROWS; row++) {
+			if (key_table[k][row].action != ACTION_NONE)
+				grab_keycode(s->root, row_mask[row], k);
+		}
+	}
+}
+
+static void
+grab_button(Window w, unsigned int mask)
+{
+	unsigned int locks[4] = { 0, LockMask, numlockmask,
+		numlockmask | LockMask };
+	int         n = numlockmask ? 4 : 2;
+
+	if (have_xkb) {
+		locks[0] = grab_locks;
+		n = 1;
+	}
+	for (int i = 0; i < n; i++) {
+		XGrabButton(dpy, AnyButton, mask | locks[i], w, False,
+			ButtonMask, GrabModeSync, GrabModeAsync, None, None);
+	}
+}
+
+/** grab_buttons_for_screen:
+ *  Mouse controls are grabbed once, on the root window, rather than on
+ *  every frame.  The grabs freeze the pointer until handle_button_event()
+ *  has looked for a frame under it.  The keyboard is never frozen: a
+ *  press could otherwise leave it stuck on any path that doesn't get as
+ *  far as XAllowEvents().
+ */
+void
+grab_buttons_for_screen(struct screen_info * s)
+{
+	XUngrabButton(dpy, AnyButton, AnyModifier, s->root);
+	grab_button(s->root, grabmask2);
+	grab_button(s->root, grabmask2 | altmask);
+}
+
+/** keys_init:
+ *  Look for XKB and build the initial key table.  Call once the modifier
+ *  masks are known and before grabbing keys.
+ */
+void
+keys_init(void)
+{
+	int         opcode, error_base;
+	int         major = XkbMajorVersion, minor = XkbMinorVersion;
+
+	have_xkb = XkbQueryExtension(dpy, &opcode, &xkb_event_base,
+		&error_base, &major, &minor);
+	if (have_xkb) {
+		XkbStateRec state;
+
+		XkbSelectEventDetails(dpy, XkbUseCoreKbd, XkbStateNotify,
+			XkbModifierLockMask, XkbModifierLockMask);
+		if (XkbGetState(dpy, XkbUseCoreKbd, &state) == Success)
+			grab_locks = state.locked_mods & (LockMask | numlockmask);
+	}
+	LOG_DEBUG("XKB %s\n", have_xkb ? "available" : "not available");
+	keys_build();
+}
+
+/* Locked modifiers changed: grab keys and buttons afresh with the new ones */
+void
+handle_xkb_event(XEvent * e)
+{
+	XkbEvent   *xe = (XkbEvent *) e;
+	unsigned int locks;
+
+	if (xe->any.xkb_type != XkbStateNotify)
+		return;
+	locks = xe->state.locked_mods & (LockMask | numlockmask);
+	if (locks == grab_locks)
+		return;
+	grab_locks = locks;
+	for (int i = 0; i < num_screens; i++) {
+		grab_keys_for_screen(&screens[i]);
+		grab_buttons_for_screen(&screens[i]);
+	}
+}
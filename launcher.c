@@ -0,0 +1,301 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Launcher (-DLAUNCHER).
+ *
+ * The names of the executables in each $PATH directory are read once,
+ * shortly after startup, from a timer rather than before the first event
+ * is handled.  Each directory is watched with inotify as it is read.
+ * Nothing reads the inotify descriptor until the launcher is opened: at
+ * that point the queued events say which directories have changed, only
+ * those (and any that couldn't be watched, e.g. because they didn't exist
+ * yet or were removed) are read again, and the search index over all the
+ * names is rebuilt if anything changed.
+ *
+ * The prompt lists executables starting with, then containing, what has
+ * been typed.  Return runs the selected one; text matching nothing is run
+ * with /bin/sh -c so that arguments can be given. */
+
+#ifdef LAUNCHER
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "evilwm.h"
+#include "log.h"
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+	| IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct path_dir
+{
+	char       *path;
+	int         wd;
+	int         dirty;
+	char      **names;
+	int         num_names;
+};
+
+static struct path_dir *dirs = NULL;
+static int  num_dirs = 0;
+static int  inotify_fd = -1;
+
+/* Every name, sorted and without duplicates; points into dirs[].names */
+static char **names = NULL;
+static int  num_names = 0;
+static struct trigram_index name_index;
+static int  index_dirty = 1;
+
+static void launcher_scan(void);
+static struct timer scan_timer = {.func = launcher_scan };
+
+static void
+free_names(struct path_dir *d)
+{
+	for (int i = 0; i < d->num_names; i++)
+		free(d->names[i]);
+	free(d->names);
+	d->names = NULL;
+	d->num_names = 0;
+}
+
+static int
+is_executable(const char *dir, const char *name)
+{
+	char        path[PATH_MAX];
+	struct stat st;
+
+	if (snprintf(path, sizeof(path), "%s/%s", dir, name)
+		>= (int) sizeof(path))
+		return 0;
+	if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+		return 0;
+	return (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0;
+}
+
+/* Start watching a directory that isn't watched, e.g. because it didn't
+ * exist last time.  It must be read (again) if that works. */
+static void
+watch_dir(struct path_dir *d)
+{
+	if (d->wd >= 0 || inotify_fd < 0)
+		return;
+	d->wd = inotify_add_watch(inotify_fd, d->path, WATCH_MASK);
+	if (d->wd >= 0)
+		d->dirty = 1;
+}
+
+static void
+read_dir(struct path_dir *d)
+{
+	DIR        *dh;
+	struct dirent *de;
+	int         size = 0;
+
+	free_names(d);
+	d->dirty = 0;
+	index_dirty = 1;
+	if (!(dh = opendir(d->path)))
+		return;
+	while ((de = readdir(dh))) {
+		if (de->d_name[0] == '.' || !is_executable(d->path, de->d_name))
+			continue;
+		if (d->num_names == size) {
+			char      **nnames;
+
+			size = size ? size * 2 : 64;
+			if (!(nnames = realloc(d->names, size * sizeof(char *))))
+				break;
+			d->names = nnames;
+		}
+		if (!(d->names[d->num_names] = strdup(de->d_name)))
+			break;
+		d->num_names++;
+	}
+	closedir(dh);
+	LOG_DEBUG("%s: %d executables\n", d->path, d->num_names);
+}
+
+/* Find out which directories have changed since last time */
+static void
+read_inotify(void)
+{
+	union
+	{
+		uint32_t    align;	/* as struct inotify_event */
+		char        buf[4096];
+	} u;
+	ssize_t     len;
+
+	if (inotify_fd < 0)
+		return;
+	while ((len = read(inotify_fd, u.buf, sizeof(u.buf))) > 0) {
+		for (char *p = u.buf; p < u.buf + len;) {
+			struct inotify_event *ev = (struct inotify_event *) p;
+
+			for (int i = 0; i < num_dirs; i++) {
+				if ((ev->mask & IN_Q_OVERFLOW)
+					|| dirs[i].wd == ev->wd)
+					dirs[i].dirty = 1;
+				/* The directory went away, taking the watch
+				 * with it; watch_dir() watches whatever is
+				 * there next time */
+				if (dirs[i].wd == ev->wd && (ev->mask
+						& (IN_DELETE_SELF | IN_MOVE_SELF
+							| IN_IGNORED))) {
+					if (!(ev->mask & IN_IGNORED))
+						inotify_rm_watch(inotify_fd,
+							dirs[i].wd);
+					dirs[i].wd = -1;
+				}
+			}
+			p += sizeof(struct inotify_event) + ev->len;
+		}
+	}
+}
+
+static int
+cmp_name(const void *a, const void *b)
+{
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static void
+build_index(void)
+{
+	char      **nnames;
+	int         n = 0;
+
+	for (int i = 0; i < num_dirs; i++)
+		n += dirs[i].num_names;
+	trigram_free(&name_index);
+	free(names);
+	names = NULL;
+	num_names = 0;
+	index_dirty = 0;
+	if (!n || !(nnames = malloc(n * sizeof(char *))))
+		return;
+	names = nnames;
+	for (int i = 0; i < num_dirs; i++) {
+		for (int j = 0; j < dirs[i].num_names; j++)
+			names[num_names++] = dirs[i].names[j];
+	}
+	qsort(names, num_names, sizeof(char *), cmp_name);
+	n = 0;
+	for (int i = 0; i < num_names; i++) {
+		if (!n || strcmp(names[n - 1], names[i]) != 0)
+			names[n++] = names[i];
+	}
+	num_names = n;
+	if (!trigram_build(&name_index, (const char *const *) names,
+			num_names))
+		num_names = 0;
+}
+
+/* Bring the index up to date */
+static void
+launcher_scan(void)
+{
+	timer_cancel(&scan_timer);
+	read_inotify();
+	for (int i = 0; i < num_dirs; i++) {
+		/* Watch before reading, so that no change is missed */
+		watch_dir(&dirs[i]);
+		if (dirs[i].dirty)
+			read_dir(&dirs[i]);
+	}
+	if (!index_dirty)
+		return;
+	build_index();
+	LOG_DEBUG("launcher index: %d commands\n", num_names);
+}
+
+/** launcher_init:
+ *  List the $PATH directories and arrange for them to be read, and
+ *  watched, once the event loop is running.
+ */
+void
+launcher_init(void)
+{
+	const char *path = getenv("PATH");
+	char       *copy, *dir, *next;
+
+	if (!path || !(copy = strdup(path)))
+		return;
+	inotify_fd = inotify_init();
+	if (inotify_fd < 0) {
+		LOG_ERROR("inotify_init: %s\n", strerror(errno));
+	} else {
+		fcntl(inotify_fd, F_SETFL, O_NONBLOCK);
+		fcntl(inotify_fd, F_SETFD, FD_CLOEXEC);
+	}
+	for (dir = copy; dir; dir = next) {
+		struct path_dir *ndirs;
+
+		if ((next = strchr(dir, ':')))
+			*(next++) = 0;
+		if (!*dir)
+			continue;
+		if (!(ndirs = realloc(dirs, (num_dirs + 1) * sizeof(*dirs))))
+			break;
+		dirs = ndirs;
+		dirs[num_dirs] = (struct path_dir) {
+			.path = strdup(dir),.wd = -1,.dirty = 1};
+		if (!dirs[num_dirs].path)
+			break;
+		num_dirs++;
+	}
+	free(copy);
+	timer_schedule(&scan_timer, 0);
+}
+
+static int
+launcher_match(const char *text, int *results, int max)
+{
+	return trigram_search(&name_index, text, results, max);
+}
+
+static const char *
+launcher_item(int id)
+{
+	return names[id];
+}
+
+static const struct prompt launcher_prompt = {
+	.label = "run",
+	.match = launcher_match,
+	.item = launcher_item,
+};
+
+/** launcher_run:
+ *  Prompt for a command and run it.
+ */
+void
+launcher_run(void)
+{
+	char        text[PROMPT_MAX_TEXT];
+	int         id;
+
+	launcher_scan();
+	id = prompt_run(&launcher_prompt, text, sizeof(text));
+	if (id >= 0) {
+		const char *const cmd[] = { names[id], NULL };
+
+		spawn(cmd);
+	} else if (id == PROMPT_TEXT) {
+		const char *const cmd[] = { "/bin/sh", "-c", text, NULL };
+
+		spawn(cmd);
+	}
+}
+
+#endif
@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/select.h>
 #include <X11/cursorfont.h>
 #include "evilwm.h"
 #include "log.h"
@@ -34,26 +36,42 @@ int         have_xinerama, xinerama_event;
 #else
 #define have_xinerama 0
 #endif
+#ifdef XRES
+int         have_xres;
+#else
+#define have_xres 0
+#endif
 
 /* Things that affect user interaction */
 #define CONFIG_FILE ".evilwmrc"
+#define DEF_GRABMASK1 (ControlMask | Mod1Mask)
+#define DEF_GRABMASK2 (Mod1Mask)
+#define DEF_ALTMASK (ShiftMask)
+static const char def_fg[] = DEF_FG;
+static const char def_bg[] = DEF_BG;
+static const char def_fc[] = DEF_FC;
 static const char *opt_display = "";
 static const char *opt_font = DEF_FONT;
-static const char *opt_fg = DEF_FG;
-static const char *opt_bg = DEF_BG;
-static const char *opt_fc = DEF_FC;
+static const char *opt_fg = def_fg;
+static const char *opt_bg = def_bg;
+static const char *opt_fc = def_fc;
 static char *opt_grabmask1 = NULL;
 static char *opt_grabmask2 = NULL;
 static char *opt_altmask = NULL;
 unsigned int numlockmask = 0;
-unsigned int grabmask1 = ControlMask | Mod1Mask;
-unsigned int grabmask2 = Mod1Mask;
-unsigned int altmask = ShiftMask;
+unsigned int grabmask1 = DEF_GRABMASK1;
+unsigned int grabmask2 = DEF_GRABMASK2;
+unsigned int altmask = DEF_ALTMASK;
 static const char *const def_term[] = { DEF_TERM, NULL };
 
 char      **opt_term = (char **) def_term;
 int         opt_bw = DEF_BW;
 int         opt_snap = 0;
+int         opt_smartplace = 0;
+static int  opt_replace = 0;
+int         opt_freeze = 0;
+const char *opt_cgroup_root = NULL;
+int         opt_cgroup_weight = 1000;
 
 #ifdef SOLIDDRAG
 int         no_solid_drag = 0;	/* use solid drag by default */
@@ -65,10 +83,10 @@ unsigned int opt_vdesks = 8;
 #else
 unsigned int opt_vdesks = 0;
 #endif
-KeySym      opt_key_kill = XK_Escape;
 
 /* struct client tracking information */
 struct list *clients_tab_order = NULL;
+XContext    client_context;
 struct list *clients_mapping_order = NULL;
 struct list *clients_stacking_order = NULL;
 struct client     *current = NULL;
@@ -76,13 +94,18 @@ volatile Window initialising = None;
 
 /* Event loop will run until this flag is set */
 int         wm_exit;
+int         reload_requested = 0;
+int         restart_requested = 0;
+
+/* Command line, re-applied over the config file when it is reloaded */
+static int  saved_argc;
+static char **saved_argv;
 
 static void set_app(const char *arg);
 static void set_app_geometry(const char *arg);
 static void set_app_dock(void);
 static void set_app_vdesk(const char *arg);
 static void set_app_fixed(void);
-static void set_key_kill(const char *arg);
 
 static struct xconfig_option evilwm_options[] = {
 	{XCONFIG_STRING, "fn", &opt_font},
@@ -94,6 +117,13 @@ static struct xconfig_option evilwm_options[] = {
 	{XCONFIG_INT, "bw", &opt_bw},
 	{XCONFIG_STR_LIST, "term", &opt_term},
 	{XCONFIG_INT, "snap", &opt_snap},
+	{XCONFIG_BOOL, "smartplace", &opt_smartplace},
+	{XCONFIG_BOOL, "replace", &opt_replace},
+	{XCONFIG_BOOL, "hotspare", &opt_hotspare},
+	{XCONFIG_INT, "focusdelay", &opt_focus_delay},
+	{XCONFIG_INT, "freeze", &opt_freeze},
+	{XCONFIG_STRING, "cgroup.root", &opt_cgroup_root},
+	{XCONFIG_INT, "cgroup.weight", &opt_cgroup_weight},
 	{XCONFIG_STRING, "mask1", &opt_grabmask1},
 	{XCONFIG_STRING, "mask2", &opt_grabmask2},
 	{XCONFIG_STRING, "altmask", &opt_altmask},
@@ -109,7 +139,31 @@ static struct xconfig_option evilwm_options[] = {
 #ifdef SOLIDDRAG
 	{XCONFIG_BOOL, "nosoliddrag", &no_solid_drag},
 #endif
-	{XCONFIG_CALL_1, "key.kill", &set_key_kill},
+	{XCONFIG_STRING, "key.new", &opt_key[ACTION_NEW]},
+	{XCONFIG_STRING, "key.next", &opt_key[ACTION_NEXT]},
+	{XCONFIG_STRING, "key.dock", &opt_key[ACTION_DOCK_TOGGLE]},
+	{XCONFIG_STRING, "key.prevdesk", &opt_key[ACTION_PREVDESK]},
+	{XCONFIG_STRING, "key.nextdesk", &opt_key[ACTION_NEXTDESK]},
+	{XCONFIG_STRING, "key.toggledesk", &opt_key[ACTION_TOGGLEDESK]},
+	{XCONFIG_STRING, "key.exgphy", &opt_key[ACTION_EXGPHY]},
+	{XCONFIG_STRING, "key.fix", &opt_key[ACTION_FIX]},
+	{XCONFIG_STRING, "key.left", &opt_key[ACTION_LEFT]},
+	{XCONFIG_STRING, "key.right", &opt_key[ACTION_RIGHT]},
+	{XCONFIG_STRING, "key.down", &opt_key[ACTION_DOWN]},
+	{XCONFIG_STRING, "key.up", &opt_key[ACTION_UP]},
+	{XCONFIG_STRING, "key.topleft", &opt_key[ACTION_TOPLEFT]},
+	{XCONFIG_STRING, "key.topright", &opt_key[ACTION_TOPRIGHT]},
+	{XCONFIG_STRING, "key.bottomleft", &opt_key[ACTION_BOTTOMLEFT]},
+	{XCONFIG_STRING, "key.bottomright", &opt_key[ACTION_BOTTOMRIGHT]},
+	{XCONFIG_STRING, "key.lower", &opt_key[ACTION_LOWER]},
+	{XCONFIG_STRING, "key.altlower", &opt_key[ACTION_ALTLOWER]},
+	{XCONFIG_STRING, "key.info", &opt_key[ACTION_INFO]},
+	{XCONFIG_STRING, "key.maxvert", &opt_key[ACTION_MAXVERT]},
+	{XCONFIG_STRING, "key.max", &opt_key[ACTION_MAX]},
+	{XCONFIG_STRING, "key.fullscreen", &opt_key[ACTION_FULLSCREEN]},
+	{XCONFIG_STRING, "key.kill", &opt_key[ACTION_KILL]},
+	{XCONFIG_STRING, "key.launch", &opt_key[ACTION_LAUNCH]},
+	{XCONFIG_STRING, "key.find", &opt_key[ACTION_FIND]},
 	{XCONFIG_CALL_1, "annotate.info.outline", &set_annotate_info_outline},
 	{XCONFIG_CALL_1, "annotate.info.banner", &set_annotate_info_info},
 	{XCONFIG_CALL_1, "annotate.info.cog", &set_annotate_info_cog},
@@ -127,12 +181,16 @@ static void setup_display(void);
 static void setup_screens(void);
 static void *xmalloc(size_t size);
 static unsigned int parse_modifiers(char *s);
+static void parse_config_file(void);
+static void set_masks(void);
+static void alloc_colours(struct screen_info *s);
+static void acquire_wm_selection(struct screen_info *s);
 
 #ifdef STDIO
 static void
 helptext(void)
 {
-	puts("usage: evilwm [-display display] [-term termprog] [-fn fontname]\n" "              [-fg foreground] [-fc fixed] [-bg background] [-bw borderwidth]\n" "              [-mask1 modifiers] [-mask2 modifiers] [-altmask modifiers]\n" "              [-key.kill key] [-snap num] [-numvdesks num]\n" "              [-app name/class] [-g geometry] [-dock] [-v vdesk] [-s]\n" "             "
+	puts("usage: evilwm [-display display] [-term termprog] [-fn fontname]\n" "              [-fg foreground] [-fc fixed] [-bg background] [-bw borderwidth]\n" "              [-mask1 modifiers] [-mask2 modifiers] [-altmask modifiers]\n" "              [-key.action key] [-snap num] [-numvdesks num] [-freeze secs]\n" "              [-cgroup.root dir] [-cgroup.weight num] [-smartplace] [-replace]\n" "              [-hotspare] [-focusdelay msec] [-app name/class]\n" "              [-g geometry] [-dock] [-v vdesk] [-s]\n" "             "
 #ifdef SOLIDDRAG
 		" [-nosoliddrag]"
 #endif
@@ -148,19 +206,7 @@ main(int argc, char *argv[])
 	struct sigaction act;
 	int         argn = 1, ret;
 
-	{
-		const char *home = getenv("HOME");
-
-		if (home) {
-			char       *conffile =
-				xmalloc(strlen(home) + sizeof(CONFIG_FILE) +
-				2);
-			strcpy(conffile, home);
-			strcat(conffile, "/" CONFIG_FILE);
-			xconfig_parse_file(evilwm_options, conffile);
-			free(conffile);
-		}
-	}
+	parse_config_file();
 	ret = xconfig_parse_cli(evilwm_options, argc, argv, &argn);
 	if (ret == XCONFIG_MISSING_ARG) {
 		fprintf(stderr, "%s: missing argument to `%s'\n", argv[0],
@@ -183,12 +229,10 @@ main(int argc, char *argv[])
 		}
 	}
 
-	if (opt_grabmask1)
-		grabmask1 = parse_modifiers(opt_grabmask1);
-	if (opt_grabmask2)
-		grabmask2 = parse_modifiers(opt_grabmask2);
-	if (opt_altmask)
-		altmask = parse_modifiers(opt_altmask);
+	saved_argc = argc;
+	saved_argv = argv;
+	set_masks();
+	apps_compile();
 
 	wm_exit = 0;
 	act.sa_handler = handle_signal;
@@ -197,18 +241,33 @@ main(int argc, char *argv[])
 	sigaction(SIGTERM, &act, NULL);
 	sigaction(SIGINT, &act, NULL);
 	sigaction(SIGHUP, &act, NULL);
+	sigaction(SIGUSR1, &act, NULL);
+	sigaction(SIGUSR2, &act, NULL);
+	act.sa_flags = SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &act, NULL);
 
 	setup_display();
 	setup_screens();
+	spare_start();
+#ifdef LAUNCHER
+	launcher_init();
+#endif
 
 	event_main_loop();
 
 	/* Quit Nicely */
-	while (clients_stacking_order)
-		remove_client(clients_stacking_order->data);
+	spare_discard();
+	freeze_thaw_all();
+	boost_release();
+	if (restart_requested)
+		restart_save_state();
+	else
+		remove_all_clients();
 	XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
 	if (font)
 		XFreeFont(dpy, font);
+	XFreeCursor(dpy, move_curs);
+	XFreeCursor(dpy, resize_curs);
 	{
 		int         i;
 
@@ -216,12 +275,57 @@ main(int argc, char *argv[])
 			ewmh_deinit_screen(&screens[i]);
 			XFreeGC(dpy, screens[i].invert_gc);
 			XInstallColormap(dpy, DefaultColormap(dpy, i));
+			/* Let go of the root before giving up WM_Sn: a
+			 * window manager replacing us takes over as soon as
+			 * the selection window is destroyed */
+			XUngrabKey(dpy, AnyKey, AnyModifier, screens[i].root);
+			XUngrabButton(dpy, AnyButton, AnyModifier,
+				screens[i].root);
+			XSelectInput(dpy, screens[i].root, NoEventMask);
+			XDestroyWindow(dpy, screens[i].wm_selection_owner);
 		}
 	}
-	free(screens);
+	/* Frames are left for the new instance to take over */
+	if (restart_requested)
+		XSetCloseDownMode(dpy, RetainPermanent);
 	XCloseDisplay(dpy);
 
-	return 0;
+	if (restart_requested) {
+		execvp(saved_argv[0], saved_argv);
+		LOG_ERROR("can't restart %s: releasing windows\n",
+			saved_argv[0]);
+		/* Clients still refer to their screens */
+		restart_abandon(opt_display);
+	}
+	for (int i = 0; i < num_screens; i++)
+		free(screens[i].mru);
+	free(screens);
+	return restart_requested ? 1 : 0;
+}
+
+static void
+parse_config_file(void)
+{
+	const char *home = getenv("HOME");
+
+	if (home) {
+		char       *conffile =
+			xmalloc(strlen(home) + sizeof(CONFIG_FILE) + 2);
+		strcpy(conffile, home);
+		strcat(conffile, "/" CONFIG_FILE);
+		xconfig_parse_file(evilwm_options, conffile);
+		free(conffile);
+	}
+}
+
+static void
+set_masks(void)
+{
+	grabmask1 = opt_grabmask1 ? parse_modifiers(opt_grabmask1)
+		: DEF_GRABMASK1;
+	grabmask2 = opt_grabmask2 ? parse_modifiers(opt_grabmask2)
+		: DEF_GRABMASK2;
+	altmask = opt_altmask ? parse_modifiers(opt_altmask) : DEF_ALTMASK;
 }
 
 static void *
@@ -294,6 +398,8 @@ setup_display(void)
 		exit(1);
 	}
 
+	client_context = XUniqueContext();
+
 	move_curs = XCreateFontCursor(dpy, XC_fleur);
 	resize_curs = XCreateFontCursor(dpy, XC_plus);
 
@@ -313,6 +419,8 @@ setup_display(void)
 	}
 	XFreeModifiermap(modmap);
 
+	keys_init();
+
 	/* SHAPE extension? */
 #ifdef SHAPE
 	{
@@ -344,9 +452,133 @@ setup_display(void)
 			&& XineramaIsActive(dpy);
 	}
 #endif
+	/* X-Resource extension?  Client PIDs need version 1.2. */
+#ifdef XRES
+	{
+		int         e_dummy, major, minor;
+
+		have_xres = XResQueryExtension(dpy, &e_dummy, &e_dummy)
+			&& XResQueryVersion(dpy, &major, &minor)
+			&& (major > 1 || (major == 1 && minor >= 2));
+		if (!have_xres) {
+			LOG_DEBUG
+				("XRes 1.2 is not supported on this display.\n");
+		}
+	}
+#endif
+	if (!have_xres && (opt_freeze > 0 || opt_cgroup_root)) {
+		LOG_ERROR("no X-Resource extension: -freeze and -cgroup.root"
+			" won't find any processes\n");
+	}
 	LOG_LEAVE();
 }
 
+static void
+alloc_colours(struct screen_info * s)
+{
+	XColor      dummy;
+
+	XAllocNamedColor(dpy, DefaultColormap(dpy, s->screen), opt_fg,
+		&s->fg, &dummy);
+	XAllocNamedColor(dpy, DefaultColormap(dpy, s->screen), opt_bg,
+		&s->bg, &dummy);
+	XAllocNamedColor(dpy, DefaultColormap(dpy, s->screen), opt_fc,
+		&s->fc, &dummy);
+}
+
+/* Wait up to @msec for window @w to be destroyed */
+static int
+wait_for_destroy(Window w, int msec)
+{
+	long long   deadline = monotonic_msec() + msec;
+	XEvent      ev;
+
+	while (!XCheckTypedWindowEvent(dpy, w, DestroyNotify, &ev)) {
+		long long   now = monotonic_msec();
+		struct timeval tv;
+		fd_set      fds;
+
+		if (now >= deadline)
+			return 0;
+		tv.tv_sec = (deadline - now) / 1000;
+		tv.tv_usec = ((deadline - now) % 1000) * 1000;
+		FD_ZERO(&fds);
+		FD_SET(ConnectionNumber(dpy), &fds);
+		select(ConnectionNumber(dpy) + 1, &fds, NULL, NULL, &tv);
+	}
+	return 1;
+}
+
+/* ICCCM 2.8: become the window manager for screen @s by owning WM_Sn.  A
+ * running window manager is only replaced if -replace was given; it is
+ * expected to release its clients and destroy its selection window, which
+ * is waited for before taking over the root window. */
+static void
+acquire_wm_selection(struct screen_info *s)
+{
+	char        name[16];
+	Atom        wm_sn, manager;
+	Window      owner;
+	XSetWindowAttributes attr;
+	XEvent      ev;
+	Time        timestamp;
+
+	snprintf(name, sizeof(name), "WM_S%d", s->screen);
+	wm_sn = XInternAtom(dpy, name, False);
+	manager = XInternAtom(dpy, "MANAGER", False);
+
+	XGrabServer(dpy);
+	owner = XGetSelectionOwner(dpy, wm_sn);
+	if (owner != None) {
+		if (!opt_replace) {
+			LOG_ERROR("another window manager is running on"
+				" screen %d (try -replace)\n", s->screen);
+			exit(1);
+		}
+		XSelectInput(dpy, owner, StructureNotifyMask);
+	}
+	XUngrabServer(dpy);
+
+	/* A zero-length property change yields a timestamp to own the
+	 * selection with */
+	attr.override_redirect = True;
+	attr.event_mask = PropertyChangeMask;
+	s->wm_selection_owner = XCreateWindow(dpy, s->root, -1, -1, 1, 1, 0,
+		CopyFromParent, InputOnly, CopyFromParent,
+		CWOverrideRedirect | CWEventMask, &attr);
+	XChangeProperty(dpy, s->wm_selection_owner, manager, XA_STRING, 8,
+		PropModeAppend, NULL, 0);
+	XWindowEvent(dpy, s->wm_selection_owner, PropertyChangeMask, &ev);
+	timestamp = ev.xproperty.time;
+
+	XSetSelectionOwner(dpy, wm_sn, s->wm_selection_owner, timestamp);
+	if (XGetSelectionOwner(dpy, wm_sn) != s->wm_selection_owner) {
+		LOG_ERROR("couldn't acquire %s\n", name);
+		exit(1);
+	}
+	if (owner != None) {
+		long long   start = monotonic_msec();
+
+		if (!wait_for_destroy(owner, 15000)) {
+			LOG_ERROR("previous window manager on screen %d did"
+				" not exit\n", s->screen);
+		}
+		stats.handover_msec += monotonic_msec() - start;
+		LOG_DEBUG("took over screen %d in %lldms\n", s->screen,
+			monotonic_msec() - start);
+	}
+
+	ev.xclient.type = ClientMessage;
+	ev.xclient.window = s->root;
+	ev.xclient.message_type = manager;
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = timestamp;
+	ev.xclient.data.l[1] = wm_sn;
+	ev.xclient.data.l[2] = s->wm_selection_owner;
+	ev.xclient.data.l[3] = ev.xclient.data.l[4] = 0;
+	XSendEvent(dpy, s->root, False, StructureNotifyMask, &ev);
+}
+
 /* now set up each screen in turn */
 static void
 setup_screens(void)
@@ -403,24 +635,24 @@ setup_screens(void)
 		}
 #endif
 
-		XColor      dummy;
-
-		XAllocNamedColor(dpy, DefaultColormap(dpy, i), opt_fg,
-			&screens[i].fg, &dummy);
-		XAllocNamedColor(dpy, DefaultColormap(dpy, i), opt_bg,
-			&screens[i].bg, &dummy);
-		XAllocNamedColor(dpy, DefaultColormap(dpy, i), opt_fc,
-			&screens[i].fc, &dummy);
+		alloc_colours(&screens[i]);
+		screens[i].mru =
+			xmalloc((opt_vdesks + 1) * sizeof(struct client *));
+		memset(screens[i].mru, 0,
+			(opt_vdesks + 1) * sizeof(struct client *));
 
 		screens[i].invert_gc =
 			XCreateGC(dpy, screens[i].root,
 			GCFunction | GCSubwindowMode | GCLineWidth | GCFont,
 			&gv);
 
+		acquire_wm_selection(&screens[i]);
 		XChangeWindowAttributes(dpy, screens[i].root, CWEventMask,
 			&attr);
 		grab_keys_for_screen(&screens[i]);
+		grab_buttons_for_screen(&screens[i]);
 		screens[i].docks_visible = 1;
+		restart_restore_state(&screens[i]);
 
 		/* scan all the windows on this screen */
 		LOG_XENTER("XQueryTree(screen=%d)", i);
@@ -445,6 +677,178 @@ setup_screens(void)
 	LOG_LEAVE();
 }
 
+/**************************************************************************/
+/* Reloading the configuration on SIGHUP */
+
+static void
+reset_string(const char **opt, const char *def)
+{
+	if (*opt != def)
+		free((char *) *opt);
+	*opt = def;
+}
+
+/* Undo a change to an option that only takes effect on restart */
+static void
+keep_string(const char **opt, const char *old)
+{
+	if (*opt != old) {
+		free((char *) *opt);
+		*opt = old;
+	}
+}
+
+static void
+free_term(char **term)
+{
+	if (term && term != (char **) def_term) {
+		free(term[0]);
+		free(term);
+	}
+}
+
+static int
+same_term(char *const *a, char *const *b)
+{
+	if (a == b)
+		return 1;
+	if (!a || !b)
+		return 0;
+	for (; *a && *b; a++, b++) {
+		if (strcmp(*a, *b) != 0)
+			return 0;
+	}
+	return !*a && !*b;
+}
+
+/* Put every option that reload_config() applies back to its default, so
+ * that options removed from the config file don't linger */
+static void
+reset_options(void)
+{
+	reset_string(&opt_fg, def_fg);
+	reset_string(&opt_bg, def_bg);
+	reset_string(&opt_fc, def_fc);
+	free(opt_grabmask1);
+	free(opt_grabmask2);
+	free(opt_altmask);
+	opt_grabmask1 = opt_grabmask2 = opt_altmask = NULL;
+	free_term(opt_term);
+	opt_term = (char **) def_term;
+	opt_bw = DEF_BW;
+	opt_snap = 0;
+	opt_smartplace = 0;
+	opt_hotspare = 0;
+	opt_focus_delay = 0;
+	opt_freeze = 0;
+#ifdef SOLIDDRAG
+	no_solid_drag = 0;
+#endif
+	for (int i = 0; i < NUM_KEY_ACTIONS; i++) {
+		free(opt_key[i]);
+		opt_key[i] = NULL;
+	}
+	while (applications) {
+		struct application *a = applications->data;
+
+		applications = list_delete(applications, a);
+		free(a->res_name);
+		free(a->res_class);
+		free(a);
+	}
+	annotate_reset();
+}
+
+static void
+reload_colours(void)
+{
+	for (int i = 0; i < num_screens; i++) {
+		struct screen_info *s = &screens[i];
+		unsigned long old[3] = { s->fg.pixel, s->bg.pixel, s->fc.pixel };
+
+		alloc_colours(s);
+		XFreeColors(dpy, DefaultColormap(dpy, s->screen), old, 3, 0);
+	}
+}
+
+/* Apply new colours and border width to existing frames */
+static void
+reload_borders(int old_bw)
+{
+	struct list *iter;
+
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+		unsigned long pixel = c->screen->bg.pixel;
+
+		if (c == current)
+			pixel = is_fixed(c) ? c->screen->fc.pixel
+				: c->screen->fg.pixel;
+		XSetWindowBorder(dpy, c->parent, pixel);
+		/* Borderless and fullscreen clients keep no border */
+		if (opt_bw == old_bw || c->border != old_bw
+			|| !props_want_border(c))
+			continue;
+		gravitate_border(c, -c->border);
+		c->border = opt_bw;
+		gravitate_border(c, c->border);
+		moveresize(c);
+	}
+}
+
+/** reload_config:
+ *  Re-read the config file and command line and apply the result without
+ *  touching any client that isn't affected.  The display, font, number of
+ *  vdesks and cgroup options only take effect on restart.
+ */
+void
+reload_config(void)
+{
+	long long   start = monotonic_msec();
+	const char *display = opt_display, *fontname = opt_font;
+	const char *cgroup_root = opt_cgroup_root;
+	unsigned int vdesks = opt_vdesks;
+	int         cgroup_weight = opt_cgroup_weight;
+	int         old_bw = opt_bw;
+	int         old_hotspare = opt_hotspare;
+	char      **old_term = opt_term;
+	int         argn = 1;
+
+	/* Keep the old -term list to compare against */
+	opt_term = (char **) def_term;
+	reset_options();
+	parse_config_file();
+	xconfig_parse_cli(evilwm_options, saved_argc, saved_argv, &argn);
+	keep_string(&opt_display, display);
+	keep_string(&opt_font, fontname);
+	keep_string(&opt_cgroup_root, cgroup_root);
+	opt_vdesks = vdesks;
+	opt_cgroup_weight = cgroup_weight;
+	if (opt_freeze <= 0)
+		freeze_thaw_all();
+
+	set_masks();
+	keys_build();
+	for (int i = 0; i < num_screens; i++) {
+		grab_keys_for_screen(&screens[i]);
+		grab_buttons_for_screen(&screens[i]);
+	}
+	apps_compile();
+	/* Only replace the spare if it may be the wrong program now */
+	if (opt_hotspare != old_hotspare || !same_term(opt_term, old_term)) {
+		spare_discard();
+		spare_start();
+	}
+	free_term(old_term);
+	reload_colours();
+	reload_borders(old_bw);
+	XSync(dpy, False);
+	stats.reloads++;
+	stats.last_reload_msec = monotonic_msec() - start;
+	LOG_DEBUG("configuration reloaded in %lldms\n",
+		stats.last_reload_msec);
+}
+
 /**************************************************************************/
 /* Option parsing callbacks */
 
@@ -515,12 +919,6 @@ set_app_fixed(void)
 	}
 }
 
-static void
-set_key_kill(const char *arg)
-{
-	opt_key_kill = XStringToKeysym((char *) arg);
-}
-
 /* Used for overriding the default WM modifiers */
 static unsigned int
 parse_modifiers(char *s)
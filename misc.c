@@ -6,46 +6,117 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <signal.h>
+#include <spawn.h>
 #include <string.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #include "evilwm.h"
 #include "log.h"
 
-int         need_client_tidy = 0;
+extern char **environ;
+
 int         ignore_xerror = 0;
+int         child_exited = 0;
 
-/* Now do this by fork()ing twice so we don't have to worry about SIGCHLDs */
-void
+/** spawn:
+ *  Start a program without waiting for it.  posix_spawn() avoids copying
+ *  the window manager's page tables as fork() would, the child gets the
+ *  current screen's DISPLAY in its own environment (ours is untouched) and
+ *  doesn't inherit the X connection.  Children are reaped by
+ *  reap_children() once SIGCHLD arrives.  Returns the child's pid, or -1.
+ */
+pid_t
 spawn(const char *const cmd[])
 {
 	struct screen_info *current_screen = find_current_screen();
+	const char *display = NULL;
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t    none;
+	int         n = 0, i = 0;
 	pid_t       pid;
 
 	if (current_screen && current_screen->display)
-		putenv(current_screen->display);
-	if (!(pid = fork())) {
-		setsid();
-		switch (fork()) {
-				/* execvp()'s prototype is (char *const *) suggesting that it
-				 * modifies the contents of the strings.  The prototype is this
-				 * way due to SUS maintaining compatability with older code.
-				 * However, execvp guarantees not to modify argv, so the following
-				 * cast is valid. */
-			case 0:
-				execvp(cmd[0], (char *const *) cmd);
-			default:
-				_exit(0);
-		}
+		display = current_screen->display;
+	while (environ[n])
+		n++;
+
+	char       *envp[n + 2];
+
+	for (char **e = environ; *e; e++) {
+		if (display && !strncmp(*e, "DISPLAY=", 8))
+			continue;
+		envp[i++] = *e;
 	}
-	if (pid > 0)
-		wait(NULL);
+	if (display)
+		envp[i++] = (char *) display;
+	envp[i] = NULL;
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addclose(&actions, ConnectionNumber(dpy));
+	posix_spawnattr_init(&attr);
+	sigemptyset(&none);
+	posix_spawnattr_setsigmask(&attr, &none);
+	/* Detach from our session, or at least our process group, so
+	 * signals meant for us don't reach the child */
+#ifdef POSIX_SPAWN_SETSID
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK
+		| POSIX_SPAWN_SETSID);
+#else
+	posix_spawnattr_setpgroup(&attr, 0);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK
+		| POSIX_SPAWN_SETPGROUP);
+#endif
+	/* posix_spawnp()'s prototype takes (char *const *) for argv, but it
+	 * doesn't modify the strings, so this cast is valid. */
+	if (posix_spawnp(&pid, cmd[0], &actions, &attr,
+			(char *const *) cmd, envp) != 0) {
+		LOG_ERROR("can't run %s\n", cmd[0]);
+		pid = -1;
+	}
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+	return pid;
+}
+
+/* Collect any children that have exited */
+void
+reap_children(void)
+{
+	pid_t       pid;
+
+	while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+		spare_reaped(pid);
+}
+
+/* Milliseconds on a clock unaffected by changes to the time of day */
+long long
+monotonic_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
 void
 handle_signal(int signo)
 {
-	(void) signo;		/* unused */
+	if (signo == SIGUSR1) {
+		stats_dump_requested = 1;
+		return;
+	}
+	if (signo == SIGHUP) {
+		reload_requested = 1;
+		return;
+	}
+	if (signo == SIGCHLD) {
+		child_exited = 1;
+		return;
+	}
+	if (signo == SIGUSR2)
+		restart_requested = 1;
 	wm_exit = 1;
 }
 
@@ -89,8 +160,7 @@ handle_xerror(Display * dsply, XErrorEvent * e)
 	c = find_client(e->resourceid);
 	if (c) {
 		LOG_DEBUG("flagging client for removal\n");
-		c->remove = 1;
-		need_client_tidy = 1;
+		queue_remove_client(c);
 	} else {
 		LOG_DEBUG("unknown error: not handling\n");
 	}
@@ -0,0 +1,202 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Most-recently-used focus history.
+ *
+ * Each screen keeps one list per vdesk, plus one for fixed clients, of the
+ * clients on it, most recently selected first.  Docks are in none.  A
+ * client is moved to the head of its list, and given a new stamp, when it
+ * is selected or moves to another vdesk, so each list is also in
+ * descending order of stamp.
+ *
+ * Cycling (Alt+Tab) merges the lists that are on display - the vdesk of
+ * each physical screen and the fixed list, on every screen - by stamp,
+ * keeping a cursor in each.  A step costs one comparison per list on
+ * display, however many clients there are elsewhere.  Selections made
+ * while cycling don't reorder anything; when the key is released, the
+ * client finally chosen moves to the head of its list. */
+
+#include <stdlib.h>
+#include "evilwm.h"
+#include "log.h"
+
+static unsigned long mru_clock = 0;
+
+/* Cycling state */
+static int  cycling = 0;
+static struct client **cursors = NULL;
+static int  num_cursors = 0;
+
+static struct client **
+list_for(struct client * c)
+{
+	if (c->is_dock || !c->screen->mru)
+		return NULL;
+	if (is_fixed(c))
+		return &c->screen->mru[opt_vdesks];
+	if (c->vdesk >= opt_vdesks)
+		return NULL;
+	return &c->screen->mru[c->vdesk];
+}
+
+static void
+unlink_client(struct client * c)
+{
+	if (!c->mru_list)
+		return;
+	if (c->mru_prev)
+		c->mru_prev->mru_next = c->mru_next;
+	else
+		*c->mru_list = c->mru_next;
+	if (c->mru_next)
+		c->mru_next->mru_prev = c->mru_prev;
+	c->mru_prev = c->mru_next = NULL;
+	c->mru_list = NULL;
+}
+
+static void
+push_client(struct client * c, struct client ** list)
+{
+	c->mru_stamp = ++mru_clock;
+	c->mru_list = list;
+	if (!list)
+		return;
+	c->mru_prev = NULL;
+	c->mru_next = *list;
+	if (*list)
+		(*list)->mru_prev = c;
+	*list = c;
+}
+
+/** mru_touch:
+ *  Record @c as the most recently used client.  Called by
+ *  select_client(); has no effect while cycling.
+ */
+void
+mru_touch(struct client * c)
+{
+	if (!c || cycling)
+		return;
+	unlink_client(c);
+	push_client(c, list_for(c));
+}
+
+/** mru_update:
+ *  Refile @c after its vdesk (or dock status) may have changed.
+ */
+void
+mru_update(struct client * c)
+{
+	struct client    **list = list_for(c);
+
+	if (list == c->mru_list && c->mru_stamp)
+		return;
+	unlink_client(c);
+	push_client(c, list);
+}
+
+/* Called as a client is released */
+void
+mru_remove(struct client * c)
+{
+	for (int i = 0; i < num_cursors; i++) {
+		if (cursors[i] == c)
+			cursors[i] = c->mru_next;
+	}
+	unlink_client(c);
+}
+
+/* Position a cursor at the head of each list on display */
+static int
+cycle_start(void)
+{
+	int         n = 0;
+
+	for (int i = 0; i < num_screens; i++)
+		n += screens[i].num_physical + 1;
+	free(cursors);
+	cursors = malloc(n * sizeof(struct client *));
+	num_cursors = 0;
+	if (!cursors)
+		return 0;
+	for (int i = 0; i < num_screens; i++) {
+		struct screen_info *s = &screens[i];
+
+		if (!s->mru)
+			continue;
+		cursors[num_cursors++] = s->mru[opt_vdesks];
+		for (int j = 0; j < s->num_physical; j++) {
+			unsigned int v = s->physical[j].vdesk;
+
+			if (v < opt_vdesks)
+				cursors[num_cursors++] = s->mru[v];
+		}
+	}
+	return 1;
+}
+
+/* Take the most recent client from under the cursors, or NULL once all
+ * are exhausted.  Clients waiting to be released, and docks, are passed
+ * over. */
+static struct client *
+cycle_pop(void)
+{
+	for (;;) {
+		int         best = -1;
+
+		for (int i = 0; i < num_cursors; i++) {
+			if (cursors[i] && (best < 0
+					|| cursors[i]->mru_stamp
+					> cursors[best]->mru_stamp))
+				best = i;
+		}
+		if (best < 0)
+			return NULL;
+		struct client     *c = cursors[best];
+
+		cursors[best] = c->mru_next;
+		if (!c->remove && !c->is_dock)
+			return c;
+	}
+}
+
+/** mru_cycle_next:
+ *  Return the client after the current one in the merged history of
+ *  everything on display, starting again from the top at the end.
+ *  Returns NULL if there is none but the current client.
+ */
+struct client *
+mru_cycle_next(void)
+{
+	struct client     *c;
+
+	if (!cycling) {
+		if (!cycle_start())
+			return NULL;
+		cycling = 1;
+		/* Skip the current client, normally first */
+		c = cycle_pop();
+		if (c && c != current)
+			return c;
+	}
+	if ((c = cycle_pop()))
+		return c;
+	/* Wrap around */
+	cycle_start();
+	c = cycle_pop();
+	return c == current ? NULL : c;
+}
+
+/** mru_cycle_end:
+ *  Finish cycling: the current client becomes the most recent.
+ */
+void
+mru_cycle_end(void)
+{
+	cycling = 0;
+	free(cursors);
+	cursors = NULL;
+	num_cursors = 0;
+	mru_touch(current);
+}
@@ -2,6 +2,7 @@
  * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
  * see README for license and other details. */
 
+#include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,7 +10,7 @@
 #include "evilwm.h"
 #include "log.h"
 
-static void init_geometry(struct client * c);
+static int  init_geometry(struct client * c);
 static void reparent(struct client * c);
 static void update_window_type_flags(struct client * c, unsigned int type);
 
@@ -26,8 +27,8 @@ make_new_client(Window w, struct screen_info * s)
 {
 	struct client     *c;
 	char       *name;
-	XClassHint *class;
 	unsigned int window_type;
+	int         unplaced;
 
 	LOG_ENTER("make_new_client(window=%lx)", w);
 
@@ -78,11 +79,8 @@ make_new_client(Window w, struct screen_info * s)
 	clients_tab_order = list_prepend(clients_tab_order, c);
 	clients_mapping_order = list_append(clients_mapping_order, c);
 	clients_stacking_order = list_append(clients_stacking_order, c);
-
-	c->screen = s;
-	c->window = w;
-	c->ignore_unmap = 0;
-	c->remove = 0;
+	init_client(c, w, s);
+	client_stacked_top(c);
 
 	/* Ungrab the X server as soon as possible. Now that the client is
 	 * malloc()ed and attached to the list, it is safe for any subsequent
@@ -91,8 +89,14 @@ make_new_client(Window w, struct screen_info * s)
 
 	c->border = opt_bw;
 
+	/* Select PropertyChangeMask before reading properties, so that any
+	 * change made after the fetch is seen by handle_property_change() */
+	XSelectInput(dpy, c->window,
+		ColormapChangeMask | EnterWindowMask | PropertyChangeMask);
+	props_fetch(c);
+	c->window_type = window_type;
 	update_window_type_flags(c, window_type);
-	init_geometry(c);
+	unplaced = init_geometry(c);
 
 #ifdef DEBUG
 	{
@@ -107,10 +111,8 @@ make_new_client(Window w, struct screen_info * s)
 	}
 #endif
 
-	XSelectInput(dpy, c->window,
-		ColormapChangeMask | EnterWindowMask | PropertyChangeMask);
-
 	reparent(c);
+	c->pid = client_get_pid(c);
 
 #ifdef SHAPE
 	if (have_shape) {
@@ -119,65 +121,14 @@ make_new_client(Window w, struct screen_info * s)
 	}
 #endif
 
-	/* Read instance/class information for client and check against list
+	/* Check cached instance/class information for client against list
 	 * built with -app options */
-	class = XAllocClassHint();
-	if (class) {
-		struct list *aiter = applications;
-
-		XGetClassHint(dpy, w, class);
-		while (aiter) {
-			struct application *a = aiter->data;
-
-			if ((!a->res_name || (class->res_name
-						&& !strcmp(class->res_name,
-							a->res_name)))
-				&& (!a->res_class || (class->res_class
-						&& !strcmp(class->res_class,
-							a->res_class)))) {
-				if (a->geometry_mask & WidthValue)
-					c->width = a->width * c->width_inc;
-				if (a->geometry_mask & HeightValue)
-					c->height = a->height * c->height_inc;
-				/* Warning: these co-ordinates are in screen co-ordinates */
-				int         screen_x, screen_y;
-
-				if (!(a->geometry_mask & XValue)) {
-					screen_x = client_to_Xcoord(c, x);
-				} else {
-					if (a->geometry_mask & XNegative)
-						screen_x =
-							a->x +
-							DisplayWidth(dpy,
-							s->screen) - c->width -
-							c->border;
-					else
-						screen_x = a->x + c->border;
-				}
-				if (!(a->geometry_mask & YValue)) {
-					screen_y = client_to_Xcoord(c, y);
-				} else {
-					if (a->geometry_mask & YNegative)
-						screen_y =
-							a->y +
-							DisplayHeight(dpy,
-							s->screen) -
-							c->height - c->border;
-					else
-						screen_y = a->y + c->border;
-				}
-				client_update_screenpos(c, screen_x, screen_y);
-				moveresizeraise(c);
-				if (a->is_dock)
-					c->is_dock = 1;
-				if (a->vdesk != VDESK_NONE)
-					c->vdesk = a->vdesk;
-			}
-			aiter = aiter->next;
-		}
-		XFree(class->res_name);
-		XFree(class->res_class);
-		XFree(class);
+	if (apps_apply(c))
+		unplaced = 0;
+	/* Only now are the client's vdesk and size settled */
+	if (opt_smartplace && unplaced) {
+		place_client(c);
+		moveresize(c);
 	}
 	ewmh_init_client(c);
 	ewmh_set_net_client_list(c->screen);
@@ -196,35 +147,70 @@ make_new_client(Window w, struct screen_info * s)
 		discard_enter_events(c);
 	} else {
 		set_wm_state(c, IconicState);
+		occlusion_touch(c);
+		freeze_client_hidden(c);
 	}
 	ewmh_set_net_wm_desktop(c);
+	spatial_update(c);
+	mru_update(c);
 	LOG_LEAVE();
 }
 
-/* Calls XGetWindowAttributes, XGetWMHints and XGetWMNormalHints to determine
- * window's initial geometry. */
-static void
+/** init_client:
+ *  Set up the bookkeeping fields of a newly allocated client for window
+ *  @w, and make find_client() aware of it.
+ */
+void
+init_client(struct client * c, Window w, struct screen_info * s)
+{
+	c->screen = s;
+	c->window = w;
+	c->parent = None;
+	/* nothing has been sent yet */
+	c->sent.x = c->sent.y = INT_MIN;
+	c->sent.width = c->sent.height = c->sent.border = -1;
+	c->sent.win_width = c->sent.win_height = -1;
+	c->sent.config_x = c->sent.config_y = INT_MIN;
+	c->configure_tokens = CONFIGURE_BURST * 1000;
+	c->configure_refilled = monotonic_msec();
+	c->configures_refused = 0;
+	c->configure_mask = 0;
+	memset(&c->acct, 0, sizeof(c->acct));
+	c->acct.since = monotonic_msec();
+	XSaveContext(dpy, w, client_context, (XPointer) c);
+	c->ignore_unmap = 0;
+	c->remove = 0;
+	c->mapped = 0;
+	c->hidden = 0;
+	c->shaped = 0;
+	c->occlusion_dirty = 1;
+	c->occlusion_rect.x = c->occlusion_rect.y = 0;
+	c->occlusion_rect.width = c->occlusion_rect.height = 0;
+	c->spatial = NULL;
+	c->stack_stamp = 0;
+	c->mru_list = NULL;
+	c->mru_prev = c->mru_next = NULL;
+	c->mru_stamp = 0;
+	c->pid = 0;
+	c->unmapped_since = 0;
+}
+
+/* Calls XGetWindowAttributes and uses the cached size and MWM hints to
+ * determine window's initial geometry.  Returns 1 if the window had no
+ * position of its own, so one was made up from the pointer's. */
+static int
 init_geometry(struct client * c)
 {
 	int         need_send_config = 0;
+	int         unplaced = 0;
 	long        size_flags;
 	XWindowAttributes attr;
 	unsigned long *eprop;
 	unsigned long nitems;
-	PropMwmHints *mprop;
 	unsigned long *lprop;
 
-	if ((mprop = get_property(c->window, mwm_hints, mwm_hints, &nitems))) {
-		if (nitems >= PROP_MWM_HINTS_ELEMENTS
-			&& (mprop->flags & MWM_HINTS_DECORATIONS)
-			&& !(mprop->decorations & MWM_DECOR_ALL)
-			&& !(mprop->decorations & MWM_DECOR_BORDER)) {
-			c->border = 0;
-		}
-		XFree(mprop);
-	}
-
-	get_window_type(c);
+	if (!props_want_border(c))
+		c->border = 0;
 
 	/* Get current window attributes */
 	LOG_XENTER("XGetWindowAttributes(window=%lx)", c->window);
@@ -284,6 +270,7 @@ init_geometry(struct client * c)
 				c->width)) / c->phy->width;
 		c->ny = (y * (c->phy->height - c->border -
 				c->height)) / c->phy->height;
+		unplaced = 1;
 		need_send_config = 1;
 	}
 
@@ -331,6 +318,7 @@ init_geometry(struct client * c)
 
 	if (need_send_config)
 		send_config(c);
+	return unplaced;
 }
 
 static void
@@ -347,27 +335,51 @@ reparent(struct client * c)
 		DefaultDepth(dpy, c->screen->screen), CopyFromParent,
 		DefaultVisual(dpy, c->screen->screen),
 		CWOverrideRedirect | CWBorderPixel | CWEventMask, &p_attr);
+	c->sent.x = client_to_Xcoord(c, x) - c->border;
+	c->sent.y = client_to_Xcoord(c, y) - c->border;
+	c->sent.width = c->width;
+	c->sent.height = c->height;
+	c->sent.border = c->border;
 
 	XAddToSaveSet(dpy, c->window);
 	XSetWindowBorderWidth(dpy, c->window, 0);
 	XReparentWindow(dpy, c->window, c->parent, 0, 0);
 	XMapWindow(dpy, c->window);
-	grab_button(c->parent, grabmask2, AnyButton);
-	grab_button(c->parent, grabmask2 | altmask, AnyButton);
+	XSaveContext(dpy, c->parent, client_context, (XPointer) c);
+	/* Alt+button controls are grabbed on the root window; see
+	 * grab_buttons_for_screen() */
+}
+
+/** adopt_frame:
+ *  Take over a frame left behind by a previous instance handing over
+ *  with restart_save_state(), rather than creating one with reparent().
+ *  The frame's geometry is assumed to match the client's.
+ */
+void
+adopt_frame(struct client * c, Window parent)
+{
+	XSetWindowAttributes p_attr;
+
+	c->parent = parent;
+	p_attr.event_mask = ChildMask | ButtonPressMask | EnterWindowMask;
+	XChangeWindowAttributes(dpy, c->parent, CWEventMask, &p_attr);
+	c->sent.x = client_to_Xcoord(c, x) - c->border;
+	c->sent.y = client_to_Xcoord(c, y) - c->border;
+	c->sent.width = c->sent.win_width = c->width;
+	c->sent.height = c->sent.win_height = c->height;
+	c->sent.border = c->border;
+	XAddToSaveSet(dpy, c->window);
+	XSaveContext(dpy, c->parent, client_context, (XPointer) c);
 }
 
-/* Get WM_NORMAL_HINTS property */
+/* Apply cached WM_NORMAL_HINTS property */
 long
 get_wm_normal_hints(struct client * c)
 {
-	XSizeHints *size;
+	XSizeHints *size = &c->normal_hints;
 	long        flags;
-	long        dummy;
 
-	size = XAllocSizeHints();
-
-	LOG_XENTER("XGetWMNormalHints(window=%lx)", c->window);
-	XGetWMNormalHints(dpy, c->window, size, &dummy);
+	LOG_XENTER("get_wm_normal_hints(window=%lx)", c->window);
 	debug_wm_normal_hints(size);
 	LOG_XLEAVE();
 	flags = size->flags;
@@ -405,7 +417,6 @@ get_wm_normal_hints(struct client * c)
 		c->win_gravity_hint = NorthWestGravity;
 	}
 	c->win_gravity = c->win_gravity_hint;
-	XFree(size);
 	return flags;
 }
 
@@ -415,13 +426,11 @@ update_window_type_flags(struct client * c, unsigned int type)
 	c->is_dock = (type & EWMH_WINDOW_TYPE_DOCK) ? 1 : 0;
 }
 
-/* Determine window type and update flags accordingly */
+/* Update flags according to cached window type */
 void
 get_window_type(struct client * c)
 {
-	unsigned int type = ewmh_get_net_wm_window_type(c->window);
-
-	update_window_type_flags(c, type);
+	update_window_type_flags(c, c->window_type);
 }
 
 #ifdef XDEBUG
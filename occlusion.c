@@ -0,0 +1,129 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Occlusion tracking.  Clients whose frames are unmapped (other vdesks,
+ * hidden docks) or entirely covered by frames above them get
+ * _NET_WM_STATE_HIDDEN, so well-behaved applications can stop drawing.
+ *
+ * Changes to a client's geometry, stacking or map state are recorded with
+ * occlusion_touch(), which adds the area the client covered before and
+ * covers now to its screen's damage region.  occlusion_update() is called
+ * once the event queue is drained and re-evaluates only those clients that
+ * were touched or that intersect the damage. */
+
+#include <stdlib.h>
+#include "evilwm.h"
+#include "log.h"
+
+int         occlusion_pending = 0;
+
+/* Per-screen damage, indexed by screen number */
+static Region *damage = NULL;
+
+static void
+add_damage(struct screen_info * s, XRectangle * r)
+{
+	if (!damage) {
+		damage = calloc(num_screens, sizeof(Region));
+		if (!damage)
+			return;
+	}
+	if (!damage[s->screen])
+		damage[s->screen] = XCreateRegion();
+	if (r->width && r->height)
+		XUnionRectWithRegion(r, damage[s->screen], damage[s->screen]);
+	occlusion_pending = 1;
+}
+
+void
+occlusion_touch(struct client * c)
+{
+	XRectangle  r;
+
+	add_damage(c->screen, &c->occlusion_rect);
+	client_frame_rect(c, &r);
+	add_damage(c->screen, &r);
+	c->occlusion_dirty = 1;
+}
+
+/* Client is going away: whatever it covered needs looking at again. */
+void
+occlusion_forget(struct client * c)
+{
+	add_damage(c->screen, &c->occlusion_rect);
+}
+
+static void
+update_screen(struct screen_info * s)
+{
+	Region      d = damage[s->screen];
+	int         n = 0, i;
+	struct list *iter;
+
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		if (((struct client *) iter->data)->screen == s)
+			n++;
+	}
+	if (n == 0)
+		return;
+
+	struct client     *stack[n];
+
+	i = 0;
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+
+		if (c->screen == s)
+			stack[i++] = c;
+	}
+
+	Region      covered = XCreateRegion();
+
+	/* top to bottom */
+	for (i = n - 1; i >= 0; i--) {
+		struct client     *c = stack[i];
+		XRectangle  r;
+		int         hidden;
+
+		client_frame_rect(c, &r);
+		if (c->occlusion_dirty || XRectInRegion(d, r.x, r.y, r.width,
+				r.height) != RectangleOut) {
+			if (!c->mapped)
+				hidden = 1;
+			else
+				hidden = XRectInRegion(covered, r.x, r.y,
+					r.width, r.height) == RectangleIn;
+			c->occlusion_rect = r;
+			c->occlusion_dirty = 0;
+			stats.occlusion_checks++;
+			if (hidden != c->hidden) {
+				LOG_DEBUG("window=%lx %s\n", c->window,
+					hidden ? "hidden" : "visible");
+				c->hidden = hidden;
+				ewmh_set_net_wm_state(c);
+				stats.occlusion_changes++;
+			}
+		}
+		/* Shaped frames may not cover their whole rectangle, so
+		 * they aren't counted as hiding anything */
+		if (c->mapped && !c->shaped)
+			XUnionRectWithRegion(&r, covered, covered);
+	}
+	XDestroyRegion(covered);
+}
+
+void
+occlusion_update(void)
+{
+	if (!occlusion_pending || !damage)
+		return;
+	occlusion_pending = 0;
+	for (int i = 0; i < num_screens; i++) {
+		if (!damage[i])
+			continue;
+		update_screen(&screens[i]);
+		XDestroyRegion(damage[i]);
+		damage[i] = NULL;
+	}
+}
@@ -0,0 +1,246 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Minimal-overlap placement of new windows (-smartplace).
+ *
+ * Candidate positions are the one evilwm would traditionally pick (from the
+ * pointer position), the corners of the physical screen and positions
+ * butting up against the edges of each window on the vdesk the new window
+ * is going to, displayed or not.  Each is scored by the total area it
+ * would overlap those frames; the lowest score wins, ties going to the
+ * candidate nearest the traditional position.  Placement happens once any
+ * -app rules have been applied, so their vdesk and size are used.
+ *
+ * Frames are held as separate arrays of left, top, right and bottom
+ * edges, padded to a multiple of the vector width, so the scoring loop
+ * works on several frames at once with GCC vector extensions (also
+ * understood by clang).  Other compilers get the scalar loop. */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "evilwm.h"
+#include "log.h"
+
+#define LANES 4
+
+/* Frames on the target vdesk, in physical screen co-ordinates */
+static struct
+{
+	int        *x0, *y0, *x1, *y1;
+	int         num, size;
+} frames;
+
+static int
+frames_reserve(int n)
+{
+	int         size = (n + LANES - 1) / LANES * LANES;
+
+	if (size <= frames.size)
+		return 1;
+	int        *nx0 = realloc(frames.x0, size * sizeof(int));
+	if (nx0)
+		frames.x0 = nx0;
+	int        *ny0 = realloc(frames.y0, size * sizeof(int));
+	if (ny0)
+		frames.y0 = ny0;
+	int        *nx1 = realloc(frames.x1, size * sizeof(int));
+	if (nx1)
+		frames.x1 = nx1;
+	int        *ny1 = realloc(frames.y1, size * sizeof(int));
+	if (ny1)
+		frames.y1 = ny1;
+	if (!nx0 || !ny0 || !nx1 || !ny1)
+		return 0;
+	frames.size = size;
+	return 1;
+}
+
+static void
+gather_frames(struct client * c)
+{
+	struct physical_screen *phy = c->phy;
+	unsigned int vdesk = is_fixed(c) ? phy->vdesk : c->vdesk;
+	struct list *iter;
+	int         n = 0, i;
+
+	frames.num = 0;
+	for (iter = clients_tab_order; iter; iter = iter->next)
+		n++;
+	if (!frames_reserve(n))
+		return;
+	i = 0;
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		struct client     *ci = iter->data;
+
+		/* c is already listed, but not yet fully initialised */
+		if (ci == c || ci->screen != c->screen || ci->phy != phy)
+			continue;
+		/* Frames on c's vdesk count whether or not it is displayed */
+		if (ci->remove)
+			continue;
+		if (!is_fixed(ci) && ci->vdesk != vdesk)
+			continue;
+		frames.x0[i] = ci->nx - ci->border;
+		frames.y0[i] = ci->ny - ci->border;
+		frames.x1[i] = ci->nx + ci->width + ci->border;
+		frames.y1[i] = ci->ny + ci->height + ci->border;
+		i++;
+	}
+	frames.num = i;
+	/* pad with empty frames, which never overlap anything */
+	for (; i % LANES; i++)
+		frames.x0[i] = frames.y0[i] = frames.x1[i] = frames.y1[i] = 0;
+}
+
+/* Total area of gathered frames overlapping the rectangle (x0,y0)-(x1,y1) */
+#if defined(__GNUC__)
+
+typedef int vint __attribute__ ((vector_size(LANES * sizeof(int))));
+
+static vint
+vload(const int *p)
+{
+	vint        v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/* Comparisons yield all-ones lanes where true, so these are branchless */
+static vint
+vmin(vint a, vint b)
+{
+	vint        m = a < b;
+
+	return (a & m) | (b & ~m);
+}
+
+static vint
+vmax(vint a, vint b)
+{
+	vint        m = a > b;
+
+	return (a & m) | (b & ~m);
+}
+
+static long
+overlap(int x0, int y0, int x1, int y1)
+{
+	vint        cx0 = {x0, x0, x0, x0}, cy0 = {y0, y0, y0, y0};
+	vint        cx1 = {x1, x1, x1, x1}, cy1 = {y1, y1, y1, y1};
+	long        total = 0;
+
+	for (int i = 0; i < frames.num; i += LANES) {
+		vint        w = vmin(cx1, vload(&frames.x1[i]))
+			- vmax(cx0, vload(&frames.x0[i]));
+		vint        h = vmin(cy1, vload(&frames.y1[i]))
+			- vmax(cy0, vload(&frames.y0[i]));
+		vint        zero = {0, 0, 0, 0};
+
+		w &= w > zero;
+		h &= h > zero;
+		vint        a = w * h;
+
+		for (int j = 0; j < LANES; j++)
+			total += a[j];
+	}
+	return total;
+}
+
+#else
+
+static long
+overlap(int x0, int y0, int x1, int y1)
+{
+	long        total = 0;
+
+	for (int i = 0; i < frames.num; i++) {
+		int         w = MIN(x1, frames.x1[i]) - MAX(x0, frames.x0[i]);
+		int         h = MIN(y1, frames.y1[i]) - MAX(y0, frames.y0[i]);
+
+		if (w > 0 && h > 0)
+			total += (long) w * h;
+	}
+	return total;
+}
+
+#endif
+
+struct placement
+{
+	int         fw, fh;	/* frame size */
+	int         max_x, max_y;	/* furthest on-screen frame position */
+	int         pref_x, pref_y;	/* traditional position */
+	int         best_x, best_y;
+	long        best_overlap;
+	long        best_dist;
+};
+
+static void
+try_position(struct placement * p, int x, int y)
+{
+	long        o, d;
+
+	x = MAX(0, MIN(x, p->max_x));
+	y = MAX(0, MIN(y, p->max_y));
+	o = overlap(x, y, x + p->fw, y + p->fh);
+	if (o > p->best_overlap)
+		return;
+	d = (long) (x - p->pref_x) * (x - p->pref_x)
+		+ (long) (y - p->pref_y) * (y - p->pref_y);
+	if (o == p->best_overlap && d >= p->best_dist)
+		return;
+	p->best_x = x;
+	p->best_y = y;
+	p->best_overlap = o;
+	p->best_dist = d;
+}
+
+/** place_client:
+ *  Choose the position of a new client that has none of its own.  c->nx
+ *  and c->ny should hold the traditional pointer-derived position; they
+ *  are replaced with the candidate overlapping the least.
+ */
+void
+place_client(struct client * c)
+{
+	struct placement p;
+
+	gather_frames(c);
+	if (!frames.num)
+		return;
+	p.fw = c->width + 2 * c->border;
+	p.fh = c->height + 2 * c->border;
+	p.max_x = MAX(0, c->phy->width - p.fw);
+	p.max_y = MAX(0, c->phy->height - p.fh);
+	p.pref_x = MAX(0, MIN(c->nx - c->border, p.max_x));
+	p.pref_y = MAX(0, MIN(c->ny - c->border, p.max_y));
+	p.best_overlap = LONG_MAX;
+	p.best_dist = LONG_MAX;
+
+	try_position(&p, p.pref_x, p.pref_y);
+	if (p.best_overlap) {
+		try_position(&p, 0, 0);
+		try_position(&p, p.max_x, 0);
+		try_position(&p, 0, p.max_y);
+		try_position(&p, p.max_x, p.max_y);
+	}
+	for (int i = 0; i < frames.num && p.best_overlap; i++) {
+		/* right of, left of, below and above each frame, aligned with
+		 * either of its edges */
+		try_position(&p, frames.x1[i], frames.y0[i]);
+		try_position(&p, frames.x1[i], frames.y1[i] - p.fh);
+		try_position(&p, frames.x0[i] - p.fw, frames.y0[i]);
+		try_position(&p, frames.x0[i] - p.fw, frames.y1[i] - p.fh);
+		try_position(&p, frames.x0[i], frames.y1[i]);
+		try_position(&p, frames.x1[i] - p.fw, frames.y1[i]);
+		try_position(&p, frames.x0[i], frames.y0[i] - p.fh);
+		try_position(&p, frames.x1[i] - p.fw, frames.y0[i] - p.fh);
+	}
+	LOG_DEBUG("placed at +%d+%d, overlap %ld\n", p.best_x, p.best_y,
+		p.best_overlap);
+	c->nx = p.best_x + c->border;
+	c->ny = p.best_y + c->border;
+}
@@ -0,0 +1,424 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Policies applied to the processes behind client windows.  The server
+ * says which process holds each window's connection (X-Resource 1.2), so
+ * only local clients are found, and a client can't point us at some other
+ * process.  Without XRes, no process is ever found. */
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "evilwm.h"
+#include "log.h"
+
+#ifndef HOST_NAME_MAX
+#define HOST_NAME_MAX 255
+#endif
+
+/** window_get_net_wm_pid:
+ *  The local process a window claims, through _NET_WM_PID, to belong to.
+ *  Anything can set that property, so this is only good enough to
+ *  recognise a process we started; never signal the result.  Returns 0 if
+ *  unknown or remote.
+ */
+pid_t
+window_get_net_wm_pid(Window w)
+{
+	static char hostname[HOST_NAME_MAX + 1];
+	unsigned long nitems;
+	unsigned long *lprop;
+	XTextProperty machine;
+	pid_t       pid = 0;
+
+	if (!hostname[0]) {
+		if (gethostname(hostname, sizeof(hostname) - 1) != 0)
+			return 0;
+	}
+	if (!XGetWMClientMachine(dpy, w, &machine))
+		return 0;
+	if (machine.value && machine.format == 8
+		&& !strcmp((char *) machine.value, hostname)) {
+		if ((lprop = get_property(w, xa_net_wm_pid,
+					XA_CARDINAL, &nitems))) {
+			if (nitems)
+				pid = lprop[0];
+			XFree(lprop);
+		}
+	}
+	if (machine.value)
+		XFree(machine.value);
+	/* never act on init or ourselves */
+	if (pid <= 1 || pid == getpid())
+		return 0;
+	return pid;
+}
+
+/** window_get_pid:
+ *  The local process holding the X connection that created a window, as
+ *  the server reports it through the X-Resource extension.  Unlike
+ *  _NET_WM_PID this can't be forged by the client, so it is safe to
+ *  signal.  Returns 0 if unknown, remote, or XRes is unavailable.
+ */
+pid_t
+window_get_pid(Window w)
+{
+	pid_t       pid = 0;
+#ifdef XRES
+	XResClientIdSpec spec = {.client = w,.mask = XRES_CLIENT_ID_PID_MASK };
+	XResClientIdValue *ids = NULL;
+	long        nids = 0;
+
+	if (!have_xres)
+		return 0;
+	if (XResQueryClientIds(dpy, 1, &spec, &nids, &ids) != Success)
+		return 0;
+	for (long i = 0; i < nids; i++) {
+		if (XResGetClientIdType(&ids[i]) == XRES_CLIENT_ID_PID) {
+			pid = XResGetClientPid(&ids[i]);
+			break;
+		}
+	}
+	XResClientIdsDestroy(nids, ids);
+	/* never act on init or ourselves */
+	if (pid <= 1 || pid == getpid())
+		return 0;
+#else
+	(void) w;
+#endif
+	return pid;
+}
+
+pid_t
+client_get_pid(struct client * c)
+{
+	return window_get_pid(c->window);
+}
+
+/*
+ * Freezing processes whose windows have all been on hidden vdesks for
+ * longer than opt_freeze seconds.
+ */
+
+static pid_t *frozen = NULL;
+static int  num_frozen = 0;
+static void freeze_check(void);
+static struct timer freeze_timer = {.func = freeze_check };
+
+static int
+is_frozen(pid_t pid)
+{
+	for (int i = 0; i < num_frozen; i++) {
+		if (frozen[i] == pid)
+			return 1;
+	}
+	return 0;
+}
+
+static void
+freeze_pid(pid_t pid)
+{
+	pid_t      *nfrozen = realloc(frozen, (num_frozen + 1) * sizeof(pid_t));
+
+	if (!nfrozen)
+		return;
+	frozen = nfrozen;
+	if (kill(pid, SIGSTOP) != 0)
+		return;
+	LOG_DEBUG("froze pid %ld\n", (long) pid);
+	frozen[num_frozen++] = pid;
+	stats.pids_frozen++;
+}
+
+static void
+thaw_pid(pid_t pid)
+{
+	for (int i = 0; i < num_frozen; i++) {
+		if (frozen[i] != pid)
+			continue;
+		kill(pid, SIGCONT);
+		LOG_DEBUG("thawed pid %ld\n", (long) pid);
+		frozen[i] = frozen[--num_frozen];
+		stats.pids_thawed++;
+		return;
+	}
+}
+
+/* A client counts towards freezing its process once its frame has been
+ * unmapped because its vdesk is not displayed for long enough.  Fixed
+ * clients and docks never do. */
+static int
+client_freezable(struct client * c, long long now)
+{
+	if (c->mapped || !c->unmapped_since || is_fixed(c) || c->is_dock)
+		return 0;
+	return now - c->unmapped_since >= (long long) opt_freeze * 1000;
+}
+
+static void
+freeze_check(void)
+{
+	long long   now = monotonic_msec();
+	long long   next = 0;
+	struct list *iter, *jter;
+
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+		int         all_hidden = 1;
+
+		if (!c->pid || is_frozen(c->pid))
+			continue;
+		if (!client_freezable(c, now)) {
+			if (!c->mapped && c->unmapped_since && !is_fixed(c)
+				&& !c->is_dock) {
+				long long   due = c->unmapped_since
+					+ (long long) opt_freeze * 1000;
+
+				if (!next || due < next)
+					next = due;
+			}
+			continue;
+		}
+		/* Processes may own more than one window: every one of them
+		 * has to qualify. */
+		for (jter = clients_tab_order; jter; jter = jter->next) {
+			struct client     *cj = jter->data;
+
+			if (cj->pid == c->pid && !client_freezable(cj, now)) {
+				all_hidden = 0;
+				break;
+			}
+		}
+		if (all_hidden)
+			freeze_pid(c->pid);
+	}
+	if (next)
+		timer_schedule(&freeze_timer, next - now);
+}
+
+/* Called as a client's frame is unmapped */
+void
+freeze_client_hidden(struct client * c)
+{
+	if (!c->unmapped_since)
+		c->unmapped_since = monotonic_msec();
+	if (opt_freeze > 0 && c->pid && !freeze_timer.active)
+		timer_schedule(&freeze_timer, (long) opt_freeze * 1000);
+}
+
+/* Called just before a client's frame is mapped: its process must be
+ * running before it is asked to draw. */
+void
+freeze_client_shown(struct client * c)
+{
+	c->unmapped_since = 0;
+	if (num_frozen && c->pid)
+		thaw_pid(c->pid);
+}
+
+/* Called as a client is released.  A stopped process can't notice its
+ * windows going away, so don't leave it stopped. */
+void
+freeze_client_removed(struct client * c)
+{
+	if (num_frozen && c->pid)
+		thaw_pid(c->pid);
+}
+
+void
+freeze_thaw_all(void)
+{
+	while (num_frozen)
+		thaw_pid(frozen[0]);
+	timer_cancel(&freeze_timer);
+}
+
+void
+freeze_dump_stats(void)
+{
+	LOG_INFO("  frozen processes: %d (%lu frozen, %lu thawed in total)\n",
+		num_frozen, stats.pids_frozen, stats.pids_thawed);
+	for (int i = 0; i < num_frozen; i++) {
+		struct list *iter;
+		int         nwindows = 0;
+
+		for (iter = clients_tab_order; iter; iter = iter->next) {
+			if (((struct client *) iter->data)->pid == frozen[i])
+				nwindows++;
+		}
+		LOG_INFO("    pid %ld (%d windows)\n", (long) frozen[i],
+			nwindows);
+	}
+}
+
+/*
+ * Boosting the CPU weight of the focused client's process using cgroup v2.
+ * The focused process is moved into the "focus" group under
+ * opt_cgroup_root, whose cpu.weight is opt_cgroup_weight.  The cgroup it
+ * came from (e.g. its systemd scope) is read from /proc first, and it is
+ * moved back there once it loses focus, or as we exit.  Focus changes
+ * only take effect once focus has settled, so cycling through windows
+ * doesn't thrash cgroupfs.
+ */
+
+#define BOOST_DELAY_MS 250
+#define CGROUP_MOUNT   "/sys/fs/cgroup"
+
+static pid_t boosted_pid = 0;
+static char boosted_from[PATH_MAX];	/* relative to CGROUP_MOUNT */
+static pid_t boost_target = 0;
+static int  boost_ready = 0;
+static void boost_apply(void);
+static struct timer boost_timer = {.func = boost_apply };
+
+static int
+cgroup_write_path(const char *path, long value)
+{
+	FILE       *f;
+	int         ok;
+
+	if (!(f = fopen(path, "w")))
+		return 0;
+	if (value < 0)
+		ok = fputs("+cpu\n", f) >= 0;
+	else
+		ok = fprintf(f, "%ld\n", value) > 0;
+	ok = (fclose(f) == 0) && ok;
+	return ok;
+}
+
+static int
+cgroup_write(const char *group, const char *file, long value)
+{
+	char        path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s%s%s/%s", opt_cgroup_root,
+		group ? "/" : "", group ? group : "", file);
+	return cgroup_write_path(path, value);
+}
+
+/* Find the cgroup v2 path of process @pid, relative to CGROUP_MOUNT */
+static int
+cgroup_of(pid_t pid, char *buf, size_t size)
+{
+	char        path[64], line[PATH_MAX + 8];
+	FILE       *f;
+	int         ok = 0;
+
+	snprintf(path, sizeof(path), "/proc/%ld/cgroup", (long) pid);
+	if (!(f = fopen(path, "r")))
+		return 0;
+	while (fgets(line, sizeof(line), f)) {
+		/* the unified hierarchy is listed as "0::/path" */
+		if (strncmp(line, "0::/", 4) != 0)
+			continue;
+		line[strcspn(line, "\n")] = 0;
+		ok = snprintf(buf, size, "%s", line + 3) < (int) size;
+		break;
+	}
+	fclose(f);
+	return ok;
+}
+
+/* Move the boosted process back to the cgroup it came from */
+static void
+boost_restore(void)
+{
+	char        path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s%s/cgroup.procs", CGROUP_MOUNT,
+		boosted_from);
+	if (cgroup_write_path(path, boosted_pid)) {
+		LOG_DEBUG("returned pid %ld to %s\n", (long) boosted_pid,
+			boosted_from);
+	} else if (errno != ESRCH) {
+		/* (ESRCH just means the process has gone) */
+		LOG_ERROR("can't return pid %ld to cgroup %s\n",
+			(long) boosted_pid, boosted_from);
+	}
+}
+
+static void
+cgroup_mkdir(const char *group)
+{
+	char        path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s%s%s", opt_cgroup_root,
+		group ? "/" : "", group ? group : "");
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		LOG_ERROR("can't create cgroup %s\n", path);
+	}
+}
+
+static void
+boost_init(void)
+{
+	boost_ready = 1;
+	cgroup_mkdir(NULL);
+	/* Fails harmlessly if the controller is already enabled, or if
+	 * this isn't cgroupfs at all. */
+	cgroup_write(NULL, "cgroup.subtree_control", -1);
+	cgroup_mkdir("focus");
+	if (!cgroup_write("focus", "cpu.weight", opt_cgroup_weight)) {
+		LOG_ERROR("can't set cpu.weight under %s\n", opt_cgroup_root);
+	}
+}
+
+static void
+boost_apply(void)
+{
+	if (boost_target == boosted_pid)
+		return;
+	if (!boost_ready)
+		boost_init();
+	if (boosted_pid)
+		boost_restore();
+	boosted_pid = 0;
+	/* A process whose cgroup can't be found couldn't be put back */
+	if (boost_target && cgroup_of(boost_target, boosted_from,
+			sizeof(boosted_from))
+		&& cgroup_write("focus", "cgroup.procs", boost_target)) {
+		LOG_DEBUG("boosted pid %ld\n", (long) boost_target);
+		boosted_pid = boost_target;
+		stats.pids_boosted++;
+	}
+}
+
+/* Called whenever focus changes */
+void
+boost_client_focused(struct client * c)
+{
+	if (!opt_cgroup_root)
+		return;
+	boost_target = c ? c->pid : 0;
+	if (boost_target == boosted_pid)
+		timer_cancel(&boost_timer);
+	else
+		timer_schedule(&boost_timer, BOOST_DELAY_MS);
+}
+
+/* Drop any boost, e.g. as the window manager exits */
+void
+boost_release(void)
+{
+	timer_cancel(&boost_timer);
+	boost_target = 0;
+	if (boosted_pid)
+		boost_apply();
+}
+
+void
+boost_dump_stats(void)
+{
+	if (!opt_cgroup_root)
+		return;
+	LOG_INFO("  boosted process:  %ld (%lu boosts)\n", (long) boosted_pid,
+		stats.pids_boosted);
+}
@@ -0,0 +1,185 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* A one-line text prompt with a list of matches beneath it.
+ *
+ * The prompt is an override-redirect window across the top of the current
+ * physical screen, drawn in the core font like the info banner.  While it
+ * is open the keyboard is grabbed and key presses are read directly, much
+ * as a sweep reads pointer motion.  Keys already queued are all applied
+ * before the matches are looked up again, so typing ahead never waits on
+ * a redraw per character. */
+
+#include <stdio.h>
+#include <string.h>
+#include <X11/keysym.h>
+#include <X11/Xutil.h>
+#include "evilwm.h"
+#include "log.h"
+
+#define PromptMask (KeyPressMask|ExposureMask)
+#define PROMPT_OPEN (-3)
+
+struct prompt_state
+{
+	const struct prompt *p;
+	char       *text;
+	size_t      size, len;
+	int         results[PROMPT_LINES];
+	int         nresults, sel;
+	int         changed, redraw;
+	int         ret;	/* PROMPT_OPEN until done */
+};
+
+static void
+prompt_draw(struct prompt_state *ps, struct screen_info * s, Window w,
+	int width, int lineh)
+{
+	char        line[PROMPT_MAX_TEXT + 64];
+	int         y = font->ascent + 1;
+
+	XClearWindow(dpy, w);
+	snprintf(line, sizeof(line), "%s: %s_", ps->p->label, ps->text);
+	XDrawString(dpy, w, s->invert_gc, 2, y, line, strlen(line));
+	for (int i = 0; i < ps->nresults; i++) {
+		const char *item = ps->p->item(ps->results[i]);
+
+		y += lineh;
+		XDrawString(dpy, w, s->invert_gc, 2 + lineh, y, item,
+			strlen(item));
+		if (i == ps->sel)
+			XFillRectangle(dpy, w, s->invert_gc, 0, (i + 1) * lineh,
+				width, lineh);
+	}
+}
+
+static void
+prompt_key(struct prompt_state *ps, XKeyEvent * e)
+{
+	char        buf[32];
+	KeySym      keysym;
+	int         n = XLookupString(e, buf, sizeof(buf), &keysym, NULL);
+
+	switch (keysym) {
+		case XK_Escape:
+			ps->ret = PROMPT_CANCEL;
+			break;
+		case XK_Return:
+		case XK_KP_Enter:
+			if (ps->nresults)
+				ps->ret = ps->results[ps->sel];
+			else if (ps->len)
+				ps->ret = PROMPT_TEXT;
+			else
+				ps->ret = PROMPT_CANCEL;
+			break;
+		case XK_BackSpace:
+			if (ps->len) {
+				ps->text[--ps->len] = 0;
+				ps->changed = 1;
+			}
+			break;
+		case XK_Up:
+			if (ps->sel > 0) {
+				ps->sel--;
+				ps->redraw = 1;
+			}
+			break;
+		case XK_Down:
+			if (ps->sel + 1 < ps->nresults) {
+				ps->sel++;
+				ps->redraw = 1;
+			}
+			break;
+		case XK_Tab:
+			/* Complete to the selected match */
+			if (ps->nresults) {
+				snprintf(ps->text, ps->size, "%s",
+					ps->p->item(ps->results[ps->sel]));
+				ps->len = strlen(ps->text);
+				ps->changed = 1;
+			}
+			break;
+		default:
+			if (e->state & ControlMask) {
+				if (keysym == XK_u) {
+					ps->text[ps->len = 0] = 0;
+					ps->changed = 1;
+				}
+				break;
+			}
+			for (int i = 0; i < n; i++) {
+				unsigned char ch = buf[i];
+
+				if (ch < 0x20 || ch == 0x7f
+					|| ps->len + 1 >= ps->size)
+					continue;
+				ps->text[ps->len++] = ch;
+				ps->text[ps->len] = 0;
+				ps->changed = 1;
+			}
+			break;
+	}
+}
+
+/** prompt_run:
+ *  Read a line of text on the current screen, offering @p's matches for
+ *  it.  The text typed is left in @text, which holds @size bytes.  Returns
+ *  the id of the match chosen, PROMPT_TEXT if Return was pressed with text
+ *  that matched nothing, or PROMPT_CANCEL.
+ */
+int
+prompt_run(const struct prompt *p, char *text, size_t size)
+{
+	struct prompt_state ps = {.p = p,.text = text,.size = size,
+		.changed = 1,.ret = PROMPT_OPEN
+	};
+	struct screen_info *s;
+	struct physical_screen *phy;
+	int         lineh = font->ascent + font->descent + 2;
+	XEvent      ev;
+	Window      w;
+
+	if (size > PROMPT_MAX_TEXT)
+		ps.size = PROMPT_MAX_TEXT;
+	text[0] = 0;
+	find_current_screen_and_phy(&s, &phy);
+	if (XGrabKeyboard(dpy, s->root, False, GrabModeAsync, GrabModeAsync,
+			CurrentTime) != GrabSuccess)
+		return PROMPT_CANCEL;
+	w = XCreateWindow(dpy, s->root, phy->xoff, phy->yoff, phy->width,
+		(PROMPT_LINES + 1) * lineh, 0,
+		CopyFromParent, InputOutput, CopyFromParent,
+		CWOverrideRedirect | CWSaveUnder | CWBackPixel | CWEventMask,
+		&(XSetWindowAttributes) {
+		.background_pixel = s->fg.pixel,.save_under = True,
+			.override_redirect = True,.event_mask = ExposureMask});
+	XMapRaised(dpy, w);
+
+	while (ps.ret == PROMPT_OPEN) {
+		if (ps.changed) {
+			ps.nresults = p->match(text, ps.results, PROMPT_LINES);
+			ps.sel = 0;
+			ps.changed = 0;
+			ps.redraw = 1;
+		}
+		if (ps.redraw) {
+			prompt_draw(&ps, s, w, phy->width, lineh);
+			ps.redraw = 0;
+		}
+		XMaskEvent(dpy, PromptMask, &ev);
+		do {
+			if (ev.type == KeyPress)
+				prompt_key(&ps, &ev.xkey);
+			else if (ev.xexpose.window == w && !ev.xexpose.count)
+				ps.redraw = 1;
+		} while (ps.ret == PROMPT_OPEN
+			&& XCheckMaskEvent(dpy, PromptMask, &ev));
+	}
+
+	XDestroyWindow(dpy, w);
+	XUngrabKeyboard(dpy, CurrentTime);
+	LOG_DEBUG("prompt '%s' returned %d (%s)\n", p->label, ps.ret, text);
+	return ps.ret;
+}
@@ -0,0 +1,157 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Cached client properties.
+ *
+ * WM_PROTOCOLS, the window title, WM_CLASS, _NET_WM_WINDOW_TYPE,
+ * WM_NORMAL_HINTS and _MOTIF_WM_HINTS are read once when a client is
+ * adopted and kept in struct client.  Clients are selected for
+ * PropertyChangeMask before the first fetch, so handle_property_change()
+ * sees every later change and calls props_update() to re-read just the
+ * property named by the event.  The window finder is told whenever the
+ * names it lists might have changed. */
+
+#include <string.h>
+#include "evilwm.h"
+#include "log.h"
+
+static void
+fetch_protocols(struct client * c)
+{
+	Atom       *protocols;
+	int         n;
+
+	c->has_wm_delete = 0;
+	if (!XGetWMProtocols(dpy, c->window, &protocols, &n))
+		return;
+	for (int i = 0; i < n; i++) {
+		if (protocols[i] == xa_wm_delete)
+			c->has_wm_delete = 1;
+	}
+	XFree(protocols);
+}
+
+static void
+fetch_name(struct client * c)
+{
+	if (c->name)
+		XFree(c->name);
+	c->name = NULL;
+#ifndef NOUTF8
+	Atom        actual_type;
+	int         format;
+	unsigned long dummy;
+	unsigned long name_len;
+
+	XGetWindowProperty(dpy, c->window, xa_net_wm_name, 0, -1, False,
+		xa_utf8_string, &actual_type, &format,
+		&name_len, &dummy, (unsigned char **) &c->name);
+#endif
+	if (!c->name)
+		XFetchName(dpy, c->window, &c->name);
+	finder_invalidate();
+}
+
+static void
+fetch_class(struct client * c)
+{
+	XClassHint  class;
+
+	if (c->res_name)
+		XFree(c->res_name);
+	if (c->res_class)
+		XFree(c->res_class);
+	c->res_name = c->res_class = NULL;
+	if (XGetClassHint(dpy, c->window, &class)) {
+		c->res_name = class.res_name;
+		c->res_class = class.res_class;
+	}
+	finder_invalidate();
+}
+
+static void
+fetch_normal_hints(struct client * c)
+{
+	long        dummy;
+
+	memset(&c->normal_hints, 0, sizeof(c->normal_hints));
+	XGetWMNormalHints(dpy, c->window, &c->normal_hints, &dummy);
+}
+
+static void
+fetch_mwm_hints(struct client * c)
+{
+	PropMwmHints *mprop;
+	unsigned long nitems;
+
+	memset(&c->mwm_hints, 0, sizeof(c->mwm_hints));
+	if ((mprop = get_property(c->window, mwm_hints, mwm_hints, &nitems))) {
+		if (nitems >= PROP_MWM_HINTS_ELEMENTS)
+			c->mwm_hints = *mprop;
+		XFree(mprop);
+	}
+}
+
+/** props_fetch:
+ *  Fill the property cache of a newly adopted client.  The window type is
+ *  not fetched here: make_new_client() has already read it to decide
+ *  whether to manage the window at all, and stores it in c->window_type.
+ */
+void
+props_fetch(struct client * c)
+{
+	c->name = c->res_name = c->res_class = NULL;
+	fetch_protocols(c);
+	fetch_name(c);
+	fetch_class(c);
+	fetch_normal_hints(c);
+	fetch_mwm_hints(c);
+}
+
+/** props_update:
+ *  Re-read the cached property (if any) that @atom names.  Returns 1 if
+ *  it was one of the cached properties.
+ */
+int
+props_update(struct client * c, Atom atom)
+{
+	if (atom == xa_wm_protos)
+		fetch_protocols(c);
+	else if (atom == XA_WM_NAME || atom == xa_net_wm_name)
+		fetch_name(c);
+	else if (atom == XA_WM_CLASS)
+		fetch_class(c);
+	else if (atom == xa_net_wm_window_type)
+		c->window_type = ewmh_get_net_wm_window_type(c->window);
+	else if (atom == XA_WM_NORMAL_HINTS)
+		fetch_normal_hints(c);
+	else if (atom == mwm_hints)
+		fetch_mwm_hints(c);
+	else
+		return 0;
+	return 1;
+}
+
+/* Whether _MOTIF_WM_HINTS leave the client its border */
+int
+props_want_border(struct client * c)
+{
+	return !(c->mwm_hints.flags & MWM_HINTS_DECORATIONS)
+		|| (c->mwm_hints.decorations & MWM_DECOR_ALL)
+		|| (c->mwm_hints.decorations & MWM_DECOR_BORDER);
+}
+
+/* Called as a client is released */
+void
+props_free(struct client * c)
+{
+	if (c->name)
+		XFree(c->name);
+	if (c->res_name)
+		XFree(c->res_name);
+	if (c->res_class)
+		XFree(c->res_class);
+	c->name = c->res_name = c->res_class = NULL;
+	finder_invalidate();
+}
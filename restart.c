@@ -0,0 +1,345 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Restarting in place (SIGUSR2).
+ *
+ * Rather than releasing every client and having the new image adopt them
+ * all again from scratch, the old instance writes its client state to an
+ * _EVILWM_STATE property on each root window, leaves its frames in place
+ * (with close-down mode RetainPermanent) and execs itself.  The new
+ * instance reads the property back and takes over the frames as they
+ * are: geometry, vdesk, pre-maximise geometry, stacking, tab and mapping
+ * order and focus all come from the snapshot.  Should the exec fail, the
+ * old instance connects again and releases its clients instead.
+ *
+ * The property holds a header followed by one record per client, in
+ * stacking order, bottom first. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "evilwm.h"
+#include "log.h"
+
+#define STATE_MAGIC   0x6576696cUL	/* "evil" */
+#define STATE_VERSION 1
+
+enum
+{
+	H_MAGIC, H_VERSION, H_FIELDS, H_DOCKS_VISIBLE, NUM_HEADER
+};
+
+enum
+{
+	F_WINDOW, F_PARENT, F_PHY, F_X, F_Y, F_WIDTH, F_HEIGHT, F_BORDER,
+	F_OLD_BORDER, F_OLDX, F_OLDY, F_OLDW, F_OLDH, F_VDESK, F_WINDOW_TYPE,
+	F_CMAP, F_TAB_POS, F_MAP_POS, F_FLAGS, NUM_FIELDS
+};
+
+#define FLAG_MAPPED  (1 << 0)
+#define FLAG_HIDDEN  (1 << 1)
+#define FLAG_DOCK    (1 << 2)
+#define FLAG_CURRENT (1 << 3)
+
+static unsigned long
+list_position(struct list *l, struct client * c)
+{
+	unsigned long i = 0;
+
+	for (; l && l->data != c; l = l->next)
+		i++;
+	return i;
+}
+
+static void
+save_screen(struct screen_info * s)
+{
+	struct list *iter;
+	unsigned long *data, *r;
+	int         n = 0;
+
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		if (((struct client *) iter->data)->screen == s)
+			n++;
+	}
+	data = malloc((NUM_HEADER + n * NUM_FIELDS) * sizeof(unsigned long));
+	if (!data) {
+		LOG_ERROR("out of memory saving state\n");
+		return;
+	}
+	data[H_MAGIC] = STATE_MAGIC;
+	data[H_VERSION] = STATE_VERSION;
+	data[H_FIELDS] = NUM_FIELDS;
+	data[H_DOCKS_VISIBLE] = s->docks_visible;
+	r = data + NUM_HEADER;
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+
+		if (c->screen != s)
+			continue;
+		r[F_WINDOW] = c->window;
+		r[F_PARENT] = c->parent;
+		r[F_PHY] = c->phy - s->physical;
+		r[F_X] = (long) client_to_Xcoord(c, x);
+		r[F_Y] = (long) client_to_Xcoord(c, y);
+		r[F_WIDTH] = c->width;
+		r[F_HEIGHT] = c->height;
+		r[F_BORDER] = c->border;
+		r[F_OLD_BORDER] = c->old_border;
+		r[F_OLDX] = (long) c->oldx;
+		r[F_OLDY] = (long) c->oldy;
+		r[F_OLDW] = c->oldw;
+		r[F_OLDH] = c->oldh;
+		r[F_VDESK] = c->vdesk;
+		r[F_WINDOW_TYPE] = c->window_type;
+		r[F_CMAP] = c->cmap;
+		r[F_TAB_POS] = list_position(clients_tab_order, c);
+		r[F_MAP_POS] = list_position(clients_mapping_order, c);
+		r[F_FLAGS] = (c->mapped ? FLAG_MAPPED : 0)
+			| (c->hidden ? FLAG_HIDDEN : 0)
+			| (c->is_dock ? FLAG_DOCK : 0)
+			| (c == current ? FLAG_CURRENT : 0);
+		r += NUM_FIELDS;
+	}
+	XChangeProperty(dpy, s->root, xa_evilwm_state, XA_CARDINAL, 32,
+		PropModeReplace, (unsigned char *) data,
+		NUM_HEADER + n * NUM_FIELDS);
+	free(data);
+}
+
+/** restart_save_state:
+ *  Record every client for the next instance and prepare its frame to be
+ *  left behind: the window is dropped from our save-set, so closing the
+ *  connection doesn't reparent it to the root, and the frame's event mask
+ *  is cleared so the new instance can select SubstructureRedirect on it.
+ *  The caller must then close the display in RetainPermanent mode.
+ */
+void
+restart_save_state(void)
+{
+	struct list *iter;
+
+	remove_queued_clients();
+	for (int i = 0; i < num_screens; i++)
+		save_screen(&screens[i]);
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+
+		XRemoveFromSaveSet(dpy, c->window);
+		XSelectInput(dpy, c->parent, NoEventMask);
+	}
+}
+
+/** restart_abandon:
+ *  Called once the display is closed if the new image couldn't be
+ *  exec'd.  Nothing would manage the frames left for it, so connect again
+ *  and release every client, as on quitting.
+ */
+void
+restart_abandon(const char *display)
+{
+	if (!(dpy = XOpenDisplay(display))) {
+		LOG_ERROR("can't reopen display %s\n", display);
+		return;
+	}
+	for (int i = 0; i < num_screens; i++)
+		XDeleteProperty(dpy, screens[i].root, xa_evilwm_state);
+	remove_all_clients();
+	XCloseDisplay(dpy);
+}
+
+static int
+cmp_window(const void *a, const void *b)
+{
+	Window      wa = *(const Window *) a, wb = *(const Window *) b;
+
+	return (wa > wb) - (wa < wb);
+}
+
+struct restored
+{
+	struct client     *c;
+	unsigned long pos;
+};
+
+static int
+cmp_pos(const void *a, const void *b)
+{
+	unsigned long pa = ((const struct restored *) a)->pos;
+	unsigned long pb = ((const struct restored *) b)->pos;
+
+	return (pa > pb) - (pa < pb);
+}
+
+/* Any client may write _EVILWM_STATE, so check that a record describes
+ * one of our frames: @parent must hold @w, and nothing else */
+static int
+is_frame_of(Window parent, Window w)
+{
+	Window      dw1, dw2, *children = NULL;
+	unsigned int nchildren;
+	int         ok;
+
+	if (!XQueryTree(dpy, parent, &dw1, &dw2, &children, &nchildren))
+		return 0;
+	ok = (nchildren == 1 && children[0] == w);
+	if (children)
+		XFree(children);
+	return ok;
+}
+
+static struct client *
+restore_client(struct screen_info * s, const unsigned long *r)
+{
+	struct client     *c = malloc(sizeof(struct client));
+	unsigned long phy = r[F_PHY];
+
+	if (!c)
+		return NULL;
+	init_client(c, r[F_WINDOW], s);
+	c->width = r[F_WIDTH];
+	c->height = r[F_HEIGHT];
+	c->border = r[F_BORDER];
+	c->old_border = r[F_OLD_BORDER];
+	c->oldx = (long) r[F_OLDX];
+	c->oldy = (long) r[F_OLDY];
+	c->oldw = r[F_OLDW];
+	c->oldh = r[F_OLDH];
+	c->vdesk = r[F_VDESK] & UINT32_MAX;
+	if (!valid_vdesk(c->vdesk))
+		c->vdesk = s->physical[0].vdesk;
+	c->cmap = r[F_CMAP];
+	c->mapped = (r[F_FLAGS] & FLAG_MAPPED) ? 1 : 0;
+	c->hidden = (r[F_FLAGS] & FLAG_HIDDEN) ? 1 : 0;
+
+	XSelectInput(dpy, c->window,
+		ColormapChangeMask | EnterWindowMask | PropertyChangeMask);
+	props_fetch(c);
+	c->window_type = r[F_WINDOW_TYPE];
+	get_window_type(c);
+	c->is_dock = (r[F_FLAGS] & FLAG_DOCK) ? 1 : 0;
+	get_wm_normal_hints(c);
+	client_calc_cog(c);
+	if (phy < (unsigned long) s->num_physical) {
+		c->phy = &s->physical[phy];
+		c->nx = (int) (long) r[F_X] - c->phy->xoff;
+		c->ny = (int) (long) r[F_Y] - c->phy->yoff;
+	} else {
+		client_update_screenpos(c, (long) r[F_X], (long) r[F_Y]);
+	}
+	adopt_frame(c, r[F_PARENT]);
+	c->pid = client_get_pid(c);
+#ifdef SHAPE
+	if (have_shape) {
+		XShapeSelectInput(dpy, c->window, ShapeNotifyMask);
+		set_shape(c);
+	}
+#endif
+	ewmh_init_client(c);
+	if (!c->mapped)
+		freeze_client_hidden(c);
+	occlusion_touch(c);
+	spatial_update(c);
+	return c;
+}
+
+/** restart_restore_state:
+ *  Take over the clients and frames a previous instance left on screen @s,
+ *  if any.  Frames that have since disappeared are skipped; clients whose
+ *  windows have gone are removed once the X error arrives.
+ */
+void
+restart_restore_state(struct screen_info * s)
+{
+	Atom        actual_type;
+	int         actual_format;
+	unsigned long nitems, bytes_after;
+	unsigned long *data;
+	unsigned int nwins;
+	Window      dw1, dw2, *wins = NULL;
+	struct client     *focus = NULL;
+	int         n;
+
+	if (XGetWindowProperty(dpy, s->root, xa_evilwm_state, 0L, 0x1fffffffL,
+			True, XA_CARDINAL, &actual_type, &actual_format,
+			&nitems, &bytes_after,
+			(unsigned char **) &data) != Success || !data)
+		return;
+	if (actual_type != XA_CARDINAL || nitems < NUM_HEADER
+		|| data[H_MAGIC] != STATE_MAGIC
+		|| data[H_VERSION] != STATE_VERSION
+		|| data[H_FIELDS] != NUM_FIELDS) {
+		LOG_ERROR("ignoring unrecognised saved state\n");
+		XFree(data);
+		return;
+	}
+	n = (nitems - NUM_HEADER) / NUM_FIELDS;
+	s->docks_visible = data[H_DOCKS_VISIBLE] ? 1 : 0;
+
+	/* The property may be of any size, so these aren't on the stack */
+	struct restored *tab = malloc((n > 0 ? n : 1) * sizeof(*tab));
+	struct restored *map = malloc((n > 0 ? n : 1) * sizeof(*map));
+	int         nrestored = 0;
+
+	if (!tab || !map) {
+		LOG_ERROR("out of memory restoring saved state\n");
+		free(tab);
+		free(map);
+		XFree(data);
+		return;
+	}
+	/* Only frames still present at the top level are taken over */
+	if (!XQueryTree(dpy, s->root, &dw1, &dw2, &wins, &nwins))
+		nwins = 0;
+	if (wins)
+		qsort(wins, nwins, sizeof(Window), cmp_window);
+	for (int i = 0; i < n; i++) {
+		const unsigned long *r = data + NUM_HEADER + i * NUM_FIELDS;
+		Window      parent = r[F_PARENT];
+		struct client     *c;
+
+		if (!wins || !bsearch(&parent, wins, nwins, sizeof(Window),
+				cmp_window))
+			continue;
+		if (!is_frame_of(parent, r[F_WINDOW])) {
+			LOG_DEBUG("ignoring record for window %lx: not in"
+				" frame %lx\n", r[F_WINDOW], parent);
+			continue;
+		}
+		if (!(c = restore_client(s, r)))
+			break;
+		clients_stacking_order =
+			list_append(clients_stacking_order, c);
+		client_stacked_top(c);
+		tab[nrestored].c = map[nrestored].c = c;
+		tab[nrestored].pos = r[F_TAB_POS];
+		map[nrestored].pos = r[F_MAP_POS];
+		nrestored++;
+		if (r[F_FLAGS] & FLAG_CURRENT)
+			focus = c;
+	}
+	if (wins)
+		XFree(wins);
+	XFree(data);
+
+	qsort(tab, nrestored, sizeof(struct restored), cmp_pos);
+	qsort(map, nrestored, sizeof(struct restored), cmp_pos);
+	for (int i = 0; i < nrestored; i++) {
+		clients_tab_order = list_append(clients_tab_order, tab[i].c);
+		clients_mapping_order =
+			list_append(clients_mapping_order, map[i].c);
+	}
+	/* Rebuild the focus history from the tab order */
+	for (int i = nrestored - 1; i >= 0; i--)
+		mru_touch(tab[i].c);
+	free(tab);
+	free(map);
+	LOG_DEBUG("screen %d: took over %d of %d clients\n", s->screen,
+		nrestored, n);
+	if (!nrestored)
+		return;
+	ewmh_set_net_client_list(s);
+	ewmh_set_net_client_list_stacking(s);
+	if (focus)
+		select_client(focus);
+}
@@ -9,7 +9,6 @@
 #include "evilwm.h"
 #include "log.h"
 
-static void grab_keysym(Window w, unsigned int mask, KeySym keysym);
 static void fix_screen_client(struct client * c, const struct physical_screen * old_phy);
 
 static void
@@ -149,63 +148,78 @@ absmin(int a, int b)
 	return b;
 }
 
-static void
-snap_client(struct client * c)
+struct snap_state
 {
+	struct client     *c;
 	int         dx, dy;
-	struct list *iter;
-	struct client     *ci;
+};
 
-	/* client in screen co-ordinates */
-	int         c_screen_x = client_to_Xcoord(c, x);
-	int         c_screen_y = client_to_Xcoord(c, y);
+/* Called for each client with an edge near the one being snapped */
+static void
+snap_to(struct client * ci, void *data)
+{
+	struct snap_state *st = data;
+	struct client     *c = st->c;
 
-	/* snap to other windows */
-	dx = dy = opt_snap;
-	for (iter = clients_tab_order; iter; iter = iter->next) {
-		ci = iter->data;
-		int         ci_screen_x = client_to_Xcoord(ci, x);
-		int         ci_screen_y = client_to_Xcoord(ci, y);
+	if (ci == c)
+		return;
+	if (ci->is_dock && !c->screen->docks_visible)
+		return;
 
-		if (ci == c)
-			continue;
-		if (ci->screen != c->screen)
-			continue;
-		if (!is_fixed(ci) && ci->vdesk != c->phy->vdesk)
-			continue;
-		if (ci->is_dock && !c->screen->docks_visible)
-			continue;
-		if (ci_screen_y - ci->border - c->border - c->height -
-			c_screen_y <= opt_snap
-			&& c_screen_y - c->border - ci->border - ci->height -
-			ci_screen_y <= opt_snap) {
-			dx = absmin(dx,
-				ci_screen_x + ci->width - c_screen_x +
-				c->border + ci->border);
-			dx = absmin(dx,
-				ci_screen_x + ci->width - c_screen_x -
-				c->width);
-			dx = absmin(dx,
-				ci_screen_x - c_screen_x - c->width -
-				c->border - ci->border);
-			dx = absmin(dx, ci_screen_x - c_screen_x);
-		}
-		if (ci_screen_x - ci->border - c->border - c->width -
-			c_screen_x <= opt_snap
-			&& c_screen_x - c->border - ci->border - ci->width -
-			ci_screen_x <= opt_snap) {
-			dy = absmin(dy,
-				ci_screen_y + ci->height - c_screen_y +
-				c->border + ci->border);
-			dy = absmin(dy,
-				ci_screen_y + ci->height - c_screen_y -
-				c->height);
-			dy = absmin(dy,
-				ci_screen_y - c_screen_y - c->height -
-				c->border - ci->border);
-			dy = absmin(dy, ci_screen_y - c_screen_y);
-		}
+	/* clients in screen co-ordinates */
+	int         c_screen_x = client_to_Xcoord(c, x);
+	int         c_screen_y = client_to_Xcoord(c, y);
+	int         ci_screen_x = client_to_Xcoord(ci, x);
+	int         ci_screen_y = client_to_Xcoord(ci, y);
+
+	if (ci_screen_y - ci->border - c->border - c->height -
+		c_screen_y <= opt_snap
+		&& c_screen_y - c->border - ci->border - ci->height -
+		ci_screen_y <= opt_snap) {
+		st->dx = absmin(st->dx,
+			ci_screen_x + ci->width - c_screen_x +
+			c->border + ci->border);
+		st->dx = absmin(st->dx,
+			ci_screen_x + ci->width - c_screen_x - c->width);
+		st->dx = absmin(st->dx,
+			ci_screen_x - c_screen_x - c->width -
+			c->border - ci->border);
+		st->dx = absmin(st->dx, ci_screen_x - c_screen_x);
+	}
+	if (ci_screen_x - ci->border - c->border - c->width -
+		c_screen_x <= opt_snap
+		&& c_screen_x - c->border - ci->border - ci->width -
+		ci_screen_x <= opt_snap) {
+		st->dy = absmin(st->dy,
+			ci_screen_y + ci->height - c_screen_y +
+			c->border + ci->border);
+		st->dy = absmin(st->dy,
+			ci_screen_y + ci->height - c_screen_y - c->height);
+		st->dy = absmin(st->dy,
+			ci_screen_y - c_screen_y - c->height -
+			c->border - ci->border);
+		st->dy = absmin(st->dy, ci_screen_y - c_screen_y);
 	}
+}
+
+static void
+snap_client(struct client * c)
+{
+	struct snap_state st = {.c = c };
+	int         dx, dy;
+	int         x[2], y[2];
+
+	/* snap to other windows: only those with an edge within opt_snap
+	 * (plus borders) of one of ours can contribute */
+	x[0] = client_to_Xcoord(c, x);
+	x[1] = x[0] + c->width;
+	y[0] = client_to_Xcoord(c, y);
+	y[1] = y[0] + c->height;
+	st.dx = st.dy = opt_snap;
+	spatial_near_edges(c->screen, c->phy->vdesk, x, y, opt_snap,
+		c->border, snap_to, &st);
+	dx = st.dx;
+	dy = st.dy;
 	if (abs(dx) < opt_snap)
 		c->nx += dx;
 	if (abs(dy) < opt_snap)
@@ -257,12 +271,9 @@ drag(struct client * c)
 					snap_client(c);
 
 				if (!no_solid_drag) {
-					XMoveWindow(dpy, c->parent,
-						client_to_Xcoord(c,
-							x) - c->border,
-						client_to_Xcoord(c,
-							y) - c->border);
-					send_config(c);
+					client_commit_geometry(c);
+					occlusion_touch(c);
+					spatial_update(c);
 				}
 				annotate_update(c, &annotate_drag_ctx);
 				break;
@@ -291,11 +302,9 @@ void
 moveresize(struct client * c)
 {
 	position_policy(c);
-	XMoveResizeWindow(dpy, c->parent,
-		client_to_Xcoord(c, x) - c->border, client_to_Xcoord(c,
-			y) - c->border, c->width, c->height);
-	XMoveResizeWindow(dpy, c->window, 0, 0, c->width, c->height);
-	send_config(c);
+	client_commit_geometry(c);
+	occlusion_touch(c);
+	spatial_update(c);
 }
 
 void
@@ -372,26 +381,19 @@ maximise_client(struct client * c, int action, int hv)
 	 * again.
 	 */
 	if (hv & MAXIMISE_FULLSCREEN) {
+		/* border changes are sent by moveresizeraise() below */
 		if (action == NET_WM_STATE_TOGGLE ||
 			action == NET_WM_STATE_ADD) {
-			XWindowAttributes attr;
-
-			XGetWindowAttributes(dpy, c->parent, &attr);
-			if (attr.border_width != 0) {
+			if (c->sent.border != 0) {
 				c->old_border = c->border;
 				c->border = 0;
 				c->nx = c->ny = 0;
 				c->width = c->phy->width;
 				c->height = c->phy->height;
-				XSetWindowBorderWidth(dpy, c->parent, 0);
 			} else {
-
-				XSetWindowBorderWidth(dpy, c->parent,
-					c->old_border);
 				c->border = c->old_border;
 			}
 		} else {
-			XSetWindowBorderWidth(dpy, c->parent, c->old_border);
 			c->border = c->old_border;
 		}
 
@@ -408,27 +410,7 @@ maximise_client(struct client * c, int action, int hv)
 void
 next(void)
 {
-	struct list *newl = list_find(clients_tab_order, current);
-	struct client     *newc = current;
-
-	do {
-		if (newl) {
-			newl = newl->next;
-			if (!newl && !current)
-				return;
-		}
-		if (!newl)
-			newl = clients_tab_order;
-		if (!newl)
-			return;
-		newc = newl->data;
-		if (newc == current)
-			return;
-	}
-	/* NOTE: Checking against newc->screen->vdesk implies we can Alt+Tab
-	 * across screen boundaries.  Is this what we want? */
-	while ((!is_fixed(newc) && (newc->vdesk != newc->phy->vdesk))
-		|| newc->is_dock);
+	struct client     *newc = mru_cycle_next();
 
 	if (!newc)
 		return;
@@ -442,18 +424,85 @@ next(void)
 	discard_enter_events(newc);
 }
 
-/** switch_vdesk:
- *  Switch the virtual desktop on physical screen @p of logical screen @s
- *  to @v
+/* Should the client's frame be mapped once the vdesk switch completes? */
+static int
+visible_after_switch(struct client * c)
+{
+	return should_be_mapped(c) && (!c->is_dock || c->screen->docks_visible);
+}
+
+/** show_vdesk:
+ *  Map the clients of vdesk @v on logical screen @s.  Everything that
+ *  should be visible on @s is first restacked with a single
+ *  XRestackWindows() to match clients_stacking_order, then the frames of
+ *  @v are mapped from the top of the stack down.  Mapping top-down means a
+ *  window that ends up covered is never asked to redraw the area its
+ *  neighbours above will occupy.  Returns the number of frames mapped.
  */
-bool
-switch_vdesk(struct screen_info * s, struct physical_screen * p, unsigned int v)
+static int
+show_vdesk(struct screen_info * s, unsigned int v)
 {
 	struct list *iter;
+	int         n = 0, mapped = 0, exposed = 0;
 
-#ifdef DEBUG
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+
+		if (c->screen == s && visible_after_switch(c))
+			n++;
+	}
+	if (n == 0)
+		return 0;
+
+	/* bottom to top, as in clients_stacking_order */
+	struct client     *visible[n];
+	Window      order[n];
+	int         i = 0;
+
+	for (iter = clients_stacking_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+
+		if (c->screen == s && visible_after_switch(c))
+			visible[i++] = c;
+	}
+	/* XRestackWindows() wants top to bottom */
+	for (i = 0; i < n; i++)
+		order[i] = visible[n - 1 - i]->parent;
+	XRestackWindows(dpy, order, n);
+
+	Region      covered = XCreateRegion();
+
+	for (i = n - 1; i >= 0; i--) {
+		struct client     *c = visible[i];
+		XRectangle  r;
+
+		client_frame_rect(c, &r);
+		if (c->vdesk == v) {
+			client_show(c);
+			mapped++;
+			if (XRectInRegion(covered, r.x, r.y, r.width,
+					r.height) != RectangleIn)
+				exposed++;
+		}
+		XUnionRectWithRegion(&r, covered, covered);
+	}
+	XDestroyRegion(covered);
+
+	stats.vdesk_exposed += exposed;
+	stats.last_switch.exposed = exposed;
+	return mapped;
+}
+
+/** change_vdesk:
+ *  Switch the virtual desktop on physical screen @p of logical screen @s
+ *  to @v, without publishing the new state through EWMH properties.
+ */
+static bool
+change_vdesk(struct screen_info * s, struct physical_screen * p, unsigned int v)
+{
+	struct list *iter;
 	int         hidden = 0, raised = 0;
-#endif
+
 	if (!valid_vdesk(v) && v != VDESK_NONE)
 		return false;
 
@@ -475,9 +524,7 @@ switch_vdesk(struct screen_info * s, struct physical_screen * p, unsigned int v)
 			continue;
 		if (c->vdesk == p->vdesk) {
 			client_hide(c);
-#ifdef DEBUG
 			hidden++;
-#endif
 		} else if (c->vdesk == v) {
 			/* NB, vdesk may not be on the same physical screen as previously,
 			 * so move windows onto the physical screen */
@@ -487,23 +534,110 @@ switch_vdesk(struct screen_info * s, struct physical_screen * p, unsigned int v)
 				c->phy = p;
 				fix_screen_client(c, old_phy);
 			}
-			if (!c->is_dock || s->docks_visible)
-				client_show(c);
-#ifdef DEBUG
-			raised++;
-#endif
 		}
 	}
 	/* cache the value of the current vdesk, so that user may toggle back to it */
 	s->old_vdesk = p->vdesk;
 	p->vdesk = v;
-	ewmh_set_net_current_desktop(s);
+	if (v != VDESK_NONE)
+		raised = show_vdesk(s, v);
+
+	stats.vdesk_switches++;
+	stats.vdesk_unmapped += hidden;
+	stats.vdesk_mapped += raised;
+	stats.last_switch.unmapped = hidden;
+	stats.last_switch.mapped = raised;
 	LOG_DEBUG("%d hidden, %d raised\n", hidden, raised);
 	LOG_LEAVE();
 
 	return true;
 }
 
+/** switch_vdesk:
+ *  Switch the virtual desktop on physical screen @p of logical screen @s
+ *  to @v
+ */
+bool
+switch_vdesk(struct screen_info * s, struct physical_screen * p, unsigned int v)
+{
+	if (!change_vdesk(s, p, v))
+		return false;
+	ewmh_set_net_current_desktop(s);
+	return true;
+}
+
+/* Set when any physical screen has a deferred vdesk switch pending */
+int         vdesk_switch_pending = 0;
+
+/** defer_switch_vdesk:
+ *  As switch_vdesk(), but only record @v as the target for @p.  Several
+ *  switches requested within one batch of events fold into one, applied by
+ *  commit_vdesk_switches() once the batch has been handled, so
+ *  intermediate desktops are never mapped.  Validity is checked against
+ *  the pending targets, so callers may step through desktops as though
+ *  each switch had already happened.
+ */
+bool
+defer_switch_vdesk(struct screen_info * s, struct physical_screen * p, unsigned int v)
+{
+	if (!valid_vdesk(v))
+		return false;
+	for (unsigned i = 0; i < (unsigned) s->num_physical; i++) {
+		if (v == effective_vdesk(&s->physical[i]))
+			return false;
+	}
+	if (p->pending_vdesk != VDESK_INVALID)
+		stats.vdesk_switches_coalesced++;
+	if (v == p->vdesk) {
+		/* back where we started */
+		p->pending_vdesk = VDESK_INVALID;
+	} else {
+		p->pending_vdesk = v;
+		vdesk_switch_pending = 1;
+	}
+	return true;
+}
+
+/** commit_vdesk_switches:
+ *  Apply all deferred vdesk switches, publishing the final state once per
+ *  logical screen.
+ */
+void
+commit_vdesk_switches(void)
+{
+	if (!vdesk_switch_pending)
+		return;
+	vdesk_switch_pending = 0;
+	for (int i = 0; i < num_screens; i++) {
+		struct screen_info *s = &screens[i];
+		bool        changed = false, progress;
+
+		/* Repeat, as one phy may be waiting for another to give up the
+		 * vdesk it wants. */
+		do {
+			progress = false;
+			for (int j = 0; j < s->num_physical; j++) {
+				struct physical_screen *p = &s->physical[j];
+				unsigned int v = p->pending_vdesk;
+
+				if (v == VDESK_INVALID)
+					continue;
+				if (change_vdesk(s, p, v)) {
+					changed = true;
+				} else if (p->vdesk != v) {
+					continue;
+				}
+				p->pending_vdesk = VDESK_INVALID;
+				progress = true;
+			}
+		} while (progress);
+		for (int j = 0; j < s->num_physical; j++)
+			s->physical[j].pending_vdesk = VDESK_INVALID;
+		if (changed)
+			ewmh_set_net_current_desktop(s);
+	}
+}
+
 void
 exchange_phy(struct screen_info * s)
 {
@@ -519,9 +653,10 @@ exchange_phy(struct screen_info * s)
 	/* clear the vdesks to stop switch_vdesk discovering vdesk is
 	 * already mapped and ignoring the request */
 	s->physical[0].vdesk = s->physical[1].vdesk = VDESK_NONE;
-	switch_vdesk(s, &s->physical[0], vdesk_b);
-	switch_vdesk(s, &s->physical[1], vdesk_a);
+	change_vdesk(s, &s->physical[0], vdesk_b);
+	change_vdesk(s, &s->physical[1], vdesk_a);
 	s->old_vdesk = save_old_vdesk;
+	ewmh_set_net_current_desktop(s);
 }
 
 void
@@ -670,59 +805,6 @@ find_physical_screen(struct screen_info * screen, int screen_x, int screen_y)
 	return phy;
 }
 
-static void
-grab_keysym(Window w, unsigned int mask, KeySym keysym)
-{
-	KeyCode     keycode = XKeysymToKeycode(dpy, keysym);
-
-	XGrabKey(dpy, keycode, mask, w, True, GrabModeAsync, GrabModeAsync);
-	XGrabKey(dpy, keycode, mask | LockMask, w, True,
-		GrabModeAsync, GrabModeAsync);
-	if (numlockmask) {
-		XGrabKey(dpy, keycode, mask | numlockmask, w, True,
-			GrabModeAsync, GrabModeAsync);
-		XGrabKey(dpy, keycode, mask | numlockmask | LockMask, w, True,
-			GrabModeAsync, GrabModeAsync);
-	}
-}
-
-void
-grab_keys_for_screen(struct screen_info * s)
-{
-	const KeySym keys_to_grab[] = {
-#ifdef VWM
-		KEY_FIX, KEY_PREVDESK, KEY_NEXTDESK, KEY_TOGGLEDESK,
-		XK_1, XK_2, XK_3, XK_4, XK_5, XK_6, XK_7, XK_8, XK_9, XK_0,
-		KEY_EXGPHY,
-#endif
-		KEY_NEW, KEY_KILL,
-		KEY_TOPLEFT, KEY_TOPRIGHT, KEY_BOTTOMLEFT, KEY_BOTTOMRIGHT,
-		KEY_LEFT, KEY_RIGHT, KEY_DOWN, KEY_UP,
-		KEY_LOWER, KEY_ALTLOWER, KEY_INFO, KEY_MAXVERT, KEY_MAX,
-		KEY_FULLSCREEN, KEY_DOCK_TOGGLE
-	};
-#define NUM_GRABS (int)(sizeof(keys_to_grab) / sizeof(KeySym))
-
-	const KeySym alt_keys_to_grab[] = {
-		KEY_KILL, KEY_LEFT, KEY_RIGHT, KEY_DOWN, KEY_UP,
-		KEY_MAXVERT,
-	};
-#define NUM_ALT_GRABS (int)(sizeof(alt_keys_to_grab) / sizeof(KeySym))
-
-	int         i;
-
-	/* Release any previous grabs */
-	XUngrabKey(dpy, AnyKey, AnyModifier, s->root);
-	/* Grab key combinations we're interested in */
-	for (i = 0; i < NUM_GRABS; i++) {
-		grab_keysym(s->root, grabmask1, keys_to_grab[i]);
-	}
-	for (i = 0; i < NUM_ALT_GRABS; i++) {
-		grab_keysym(s->root, grabmask1 | altmask, alt_keys_to_grab[i]);
-	}
-	grab_keysym(s->root, grabmask2, KEY_NEXT);
-}
-
 /*
  * physical screen discovery methods
  */
@@ -756,6 +838,7 @@ probe_screen_xinerama(void)
 		new_phys[j].yoff = xin_scr_info[j].y_org;
 		new_phys[j].width = xin_scr_info[j].width;
 		new_phys[j].height = xin_scr_info[j].height;
+		new_phys[j].pending_vdesk = VDESK_INVALID;
 	}
 	if (xin_scr_info)
 		XFree(xin_scr_info);
@@ -775,6 +858,7 @@ probe_screen_default(struct screen_info * s)
 	s->physical->yoff = 0;
 	s->physical->width = DisplayWidth(dpy, s->screen);
 	s->physical->height = DisplayHeight(dpy, s->screen);
+	s->physical->pending_vdesk = VDESK_INVALID;
 }
 
 #ifdef RANDR
@@ -817,6 +901,7 @@ probe_screen_xrandr(struct screen_info * s)
 		new_phys[j].yoff = rr_crtc->y;
 		new_phys[j].width = rr_crtc->width;
 		new_phys[j].height = rr_crtc->height;
+		new_phys[j].pending_vdesk = VDESK_INVALID;
 		LOG_DEBUG
 			("discovered: phy[%d]{.xoff=%d, .yoff=%d, .width=%d, .height=%d}\n",
 			j, rr_crtc->x, rr_crtc->y, rr_crtc->width,
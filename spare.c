@@ -0,0 +1,107 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Hot spare terminal (-hotspare).
+ *
+ * One terminal is started ahead of time.  When its window asks to be
+ * mapped it is recognised by _NET_WM_PID and simply not managed, so it
+ * stays withdrawn and appears in no client list.  Asking for a new
+ * terminal then adopts that window through make_new_client() as if it
+ * had just been mapped, and the next spare is started straight away.
+ *
+ * Terminals that hand their windows to a separate server process can't be
+ * matched this way; their "spare" is just managed like any other window
+ * and new terminals are spawned as normal. */
+
+#include <signal.h>
+#include "evilwm.h"
+#include "log.h"
+
+int         opt_hotspare = 0;
+
+static pid_t spare_pid = 0;
+static Window spare_window = None;
+static struct screen_info *spare_screen = NULL;
+
+/* Start a spare terminal if one is wanted and there isn't one already */
+void
+spare_start(void)
+{
+	if (!opt_hotspare || spare_pid)
+		return;
+	spare_window = None;
+	spare_pid = spawn((const char *const *) opt_term);
+	if (spare_pid < 0)
+		spare_pid = 0;
+	LOG_DEBUG("started spare terminal, pid %ld\n", (long) spare_pid);
+}
+
+/** spare_claim:
+ *  Called for a window asking to be mapped that isn't yet a client.
+ *  Returns 1 if it belongs to the spare terminal, which is then held back
+ *  unmapped rather than managed.
+ */
+int
+spare_claim(Window w, struct screen_info * s)
+{
+	if (!spare_pid || spare_window != None)
+		return 0;
+	if (window_get_net_wm_pid(w) != spare_pid)
+		return 0;
+	spare_window = w;
+	spare_screen = s;
+	LOG_DEBUG("holding spare terminal window %lx\n", w);
+	return 1;
+}
+
+/* Put the spare terminal's window on screen as a new client.  Returns 1
+ * on success, or 0 if there was none to use on screen @s. */
+static int
+spare_use(struct screen_info * s)
+{
+	Window      w = spare_window;
+
+	if (w == None || s != spare_screen)
+		return 0;
+	spare_window = None;
+	spare_pid = 0;
+	make_new_client(w, s);
+	return find_client(w) != NULL;
+}
+
+/** spawn_terminal:
+ *  Open a new terminal on the current screen, using the spare if there is
+ *  one ready.
+ */
+void
+spawn_terminal(void)
+{
+	if (!opt_hotspare || !spare_use(find_current_screen()))
+		spawn((const char *const *) opt_term);
+	spare_start();
+}
+
+/* Called for each child reaped */
+void
+spare_reaped(pid_t pid)
+{
+	if (pid && pid == spare_pid) {
+		LOG_DEBUG("spare terminal exited\n");
+		spare_pid = 0;
+		spare_window = None;
+	}
+}
+
+/* Get rid of any spare, e.g. as the window manager exits: it would
+ * otherwise be left running with nothing to show its window */
+void
+spare_discard(void)
+{
+	if (spare_window != None)
+		XKillClient(dpy, spare_window);
+	else if (spare_pid)
+		kill(spare_pid, SIGTERM);
+	spare_window = None;
+	spare_pid = 0;
+}
@@ -0,0 +1,276 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Spatial index of client edges.
+ *
+ * For each logical screen there is one index per vdesk, plus one for fixed
+ * clients.  An index holds four lists of edges (left, right, top and
+ * bottom of each client window, in screen co-ordinates) sorted by
+ * position, so "which edges lie within N pixels of here" is a binary
+ * search followed by a short scan.  The left edges also answer "which
+ * window is at this point": only those within the widest frame's width to
+ * the left of the point need checking, and clients carry a stacking stamp
+ * to pick the topmost.  spatial_update() is called whenever a client
+ * moves, resizes or changes vdesk and re-files just that client's four
+ * edges. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "evilwm.h"
+#include "log.h"
+
+struct edge
+{
+	int         pos;
+	struct client     *c;
+};
+
+struct edge_list
+{
+	struct edge *edges;
+	int         num, size;
+};
+
+enum
+{
+	EDGE_LEFT, EDGE_RIGHT, EDGE_TOP, EDGE_BOTTOM, NUM_EDGE_LISTS
+};
+
+struct spatial_index
+{
+	struct edge_list lists[NUM_EDGE_LISTS];
+	int         max_border;	/* never shrinks; only used to widen searches */
+	int         max_width;	/* likewise, widest frame ever filed */
+};
+
+/* indexes[screen][slot]; the last slot of each screen is for fixed clients */
+static struct spatial_index **indexes = NULL;
+static unsigned int num_slots;
+
+static struct spatial_index *
+find_index(struct screen_info * s, unsigned int vdesk)
+{
+	unsigned int slot;
+
+	if (!indexes) {
+		num_slots = MAX(opt_vdesks, 1) + 1;
+		indexes = calloc(num_screens, sizeof(struct spatial_index *));
+		if (!indexes)
+			return NULL;
+	}
+	if (!indexes[s->screen]) {
+		indexes[s->screen] =
+			calloc(num_slots, sizeof(struct spatial_index));
+		if (!indexes[s->screen])
+			return NULL;
+	}
+	if (vdesk == VDESK_FIXED)
+		slot = num_slots - 1;
+	else if (vdesk < num_slots - 1)
+		slot = vdesk;
+	else
+		return NULL;
+	return &indexes[s->screen][slot];
+}
+
+/* Index of first edge with position >= pos */
+static int
+lower_bound(const struct edge_list * l, int pos)
+{
+	int         lo = 0, hi = l->num;
+
+	while (lo < hi) {
+		int         mid = (lo + hi) / 2;
+
+		if (l->edges[mid].pos < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int
+edge_insert(struct edge_list * l, int pos, struct client * c)
+{
+	int         i;
+
+	if (l->num == l->size) {
+		int         nsize = l->size ? l->size * 2 : 16;
+		struct edge *nedges =
+			realloc(l->edges, nsize * sizeof(struct edge));
+		if (!nedges)
+			return 0;
+		l->edges = nedges;
+		l->size = nsize;
+	}
+	i = lower_bound(l, pos);
+	memmove(&l->edges[i + 1], &l->edges[i],
+		(l->num - i) * sizeof(struct edge));
+	l->edges[i].pos = pos;
+	l->edges[i].c = c;
+	l->num++;
+	return 1;
+}
+
+static void
+edge_delete(struct edge_list * l, int pos, struct client * c)
+{
+	for (int i = lower_bound(l, pos); i < l->num && l->edges[i].pos == pos;
+		i++) {
+		if (l->edges[i].c == c) {
+			memmove(&l->edges[i], &l->edges[i + 1],
+				(l->num - i - 1) * sizeof(struct edge));
+			l->num--;
+			return;
+		}
+	}
+}
+
+static void
+edge_positions(const XRectangle * r, int pos[NUM_EDGE_LISTS])
+{
+	pos[EDGE_LEFT] = r->x;
+	pos[EDGE_RIGHT] = r->x + r->width;
+	pos[EDGE_TOP] = r->y;
+	pos[EDGE_BOTTOM] = r->y + r->height;
+}
+
+void
+spatial_remove(struct client * c)
+{
+	int         pos[NUM_EDGE_LISTS];
+
+	if (!c->spatial)
+		return;
+	edge_positions(&c->spatial_rect, pos);
+	for (int i = 0; i < NUM_EDGE_LISTS; i++)
+		edge_delete(&c->spatial->lists[i], pos[i], c);
+	c->spatial = NULL;
+}
+
+void
+spatial_update(struct client * c)
+{
+	struct spatial_index *idx = find_index(c->screen, c->vdesk);
+	XRectangle  r;
+	int         pos[NUM_EDGE_LISTS];
+
+	/* Client window, not frame: this is what snap_client() works with */
+	r.x = client_to_Xcoord(c, x);
+	r.y = client_to_Xcoord(c, y);
+	r.width = c->width;
+	r.height = c->height;
+	/* (the border may change without the window moving) */
+	if (idx && c->width + 2 * c->border > idx->max_width)
+		idx->max_width = c->width + 2 * c->border;
+	if (idx && c->border > idx->max_border)
+		idx->max_border = c->border;
+	if (idx == c->spatial && r.x == c->spatial_rect.x
+		&& r.y == c->spatial_rect.y && r.width == c->spatial_rect.width
+		&& r.height == c->spatial_rect.height)
+		return;
+	spatial_remove(c);
+	if (!idx)
+		return;
+	edge_positions(&r, pos);
+	for (int i = 0; i < NUM_EDGE_LISTS; i++) {
+		if (!edge_insert(&idx->lists[i], pos[i], c)) {
+			while (i--)
+				edge_delete(&idx->lists[i], pos[i], c);
+			return;
+		}
+	}
+	c->spatial = idx;
+	c->spatial_rect = r;
+}
+
+/* Call func for each client in @l with an edge in [lo, hi] */
+static void
+edge_range(const struct edge_list * l, int lo, int hi,
+	void (*func) (struct client *, void *), void *data)
+{
+	for (int i = lower_bound(l, lo); i < l->num && l->edges[i].pos <= hi;
+		i++)
+		func(l->edges[i].c, data);
+}
+
+/** spatial_near_edges:
+ *  Call @func for every client on screen @s visible on @vdesk (including
+ *  fixed clients) that has a vertical edge within @dist pixels of either
+ *  x position in @x[], or a horizontal edge within @dist of either y
+ *  position in @y[].  @border is added to the search distance to allow
+ *  for the borders of both windows.  A client may be reported more than
+ *  once.
+ */
+void
+spatial_near_edges(struct screen_info * s, unsigned int vdesk,
+	const int x[2], const int y[2], int dist, int border,
+	void (*func) (struct client *, void *), void *data)
+{
+	struct spatial_index *idx[2];
+
+	idx[0] = find_index(s, vdesk);
+	idx[1] = (vdesk == VDESK_FIXED) ? NULL : find_index(s, VDESK_FIXED);
+	for (int i = 0; i < 2; i++) {
+		if (!idx[i])
+			continue;
+		int         d = dist + border + idx[i]->max_border;
+
+		for (int j = 0; j < 2; j++) {
+			edge_range(&idx[i]->lists[EDGE_LEFT], x[j] - d,
+				x[j] + d, func, data);
+			edge_range(&idx[i]->lists[EDGE_RIGHT], x[j] - d,
+				x[j] + d, func, data);
+			edge_range(&idx[i]->lists[EDGE_TOP], y[j] - d,
+				y[j] + d, func, data);
+			edge_range(&idx[i]->lists[EDGE_BOTTOM], y[j] - d,
+				y[j] + d, func, data);
+		}
+	}
+}
+
+/* Topmost mapped client in @idx whose frame contains (@x, @y), if it is
+ * above @best */
+static struct client *
+index_client_at(const struct spatial_index * idx, int x, int y,
+	struct client * best)
+{
+	const struct edge_list *l = &idx->lists[EDGE_LEFT];
+
+	/* Only frames whose window's left edge is within the widest frame
+	 * to the left of x can contain it */
+	for (int i = lower_bound(l, x + idx->max_border + 1) - 1;
+		i >= 0 && l->edges[i].pos >= x - idx->max_width; i--) {
+		struct client     *c = l->edges[i].c;
+		const XRectangle *r = &c->spatial_rect;
+		int         b = c->border;
+
+		if (!c->mapped || x < r->x - b || x >= r->x + r->width + b
+			|| y < r->y - b || y >= r->y + r->height + b)
+			continue;
+		if (!best || c->stack_stamp > best->stack_stamp)
+			best = c;
+	}
+	return best;
+}
+
+/** spatial_client_at:
+ *  Find the topmost client on screen @s visible on @vdesk (including fixed
+ *  clients) whose frame contains the point (@x, @y), in screen
+ *  co-ordinates.  Only the left edges up to one frame's width to the left
+ *  of @x are looked at.
+ */
+struct client *
+spatial_client_at(struct screen_info * s, unsigned int vdesk, int x, int y)
+{
+	struct spatial_index *idx = find_index(s, vdesk);
+	struct client     *c = NULL;
+
+	if (idx)
+		c = index_client_at(idx, x, y, c);
+	if (vdesk != VDESK_FIXED && (idx = find_index(s, VDESK_FIXED)))
+		c = index_client_at(idx, x, y, c);
+	return c;
+}
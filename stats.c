@@ -0,0 +1,201 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Runtime counters.  Sending the window manager SIGUSR1 dumps these to
+ * stdout. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "evilwm.h"
+#include "log.h"
+
+/* Number of clients listed, busiest first, and of atoms listed for each */
+#define TOP_CLIENTS 5
+#define TOP_ATOMS   3
+
+struct stats stats;
+int         stats_dump_requested = 0;
+
+static void
+count_atom(struct client * c, Atom atom)
+{
+	struct atom_count *na;
+
+	for (int i = 0; i < c->acct.num_atoms; i++) {
+		if (c->acct.atoms[i].atom == atom) {
+			c->acct.atoms[i].count++;
+			return;
+		}
+	}
+	na = realloc(c->acct.atoms,
+		(c->acct.num_atoms + 1) * sizeof(struct atom_count));
+	if (!na)
+		return;
+	c->acct.atoms = na;
+	na[c->acct.num_atoms].atom = atom;
+	na[c->acct.num_atoms].count = 1;
+	c->acct.num_atoms++;
+}
+
+/** stats_account:
+ *  Charge an event about window @w, and the @requests made while handling
+ *  it, to the client owning @w (if any).
+ */
+void
+stats_account(Window w, XEvent * ev, unsigned long requests)
+{
+	struct client     *c = find_client(w);
+
+	if (!c)
+		return;
+	c->acct.requests += requests;
+	switch (ev->type) {
+		case ConfigureRequest:
+			c->acct.configure_requests++;
+			break;
+		case PropertyNotify:
+			c->acct.property_notifies++;
+			count_atom(c, ev->xproperty.atom);
+			break;
+		case ClientMessage:
+			c->acct.client_messages++;
+			break;
+		default:
+#ifdef SHAPE
+			if (have_shape && ev->type == shape_event) {
+				c->acct.shape_notifies++;
+				break;
+			}
+#endif
+			c->acct.other_events++;
+			break;
+	}
+}
+
+static unsigned long
+client_load(const struct client * c)
+{
+	return c->acct.configure_requests + c->acct.property_notifies
+		+ c->acct.client_messages + c->acct.shape_notifies
+		+ c->acct.other_events + c->acct.requests;
+}
+
+static int
+cmp_load(const void *a, const void *b)
+{
+	unsigned long la = client_load(*(struct client * const *) a);
+	unsigned long lb = client_load(*(struct client * const *) b);
+
+	return (la < lb) - (la > lb);
+}
+
+static int
+cmp_atom_count(const void *a, const void *b)
+{
+	unsigned long ca = ((const struct atom_count *) a)->count;
+	unsigned long cb = ((const struct atom_count *) b)->count;
+
+	return (ca < cb) - (ca > cb);
+}
+
+static void
+dump_client_acct(struct client * c, long long now)
+{
+	double      secs = (now - c->acct.since) / 1000.0;
+
+	if (secs < 1.0)
+		secs = 1.0;
+	LOG_INFO("    window 0x%lx (pid %ld), %.0fs:\n", c->window,
+		(long) c->pid, secs);
+	LOG_INFO("      ConfigureRequest %lu (%.2f/s), PropertyNotify %lu"
+		" (%.2f/s)\n", c->acct.configure_requests,
+		c->acct.configure_requests / secs, c->acct.property_notifies,
+		c->acct.property_notifies / secs);
+	LOG_INFO("      ClientMessage %lu, ShapeNotify %lu (%.2f/s),"
+		" other %lu\n", c->acct.client_messages,
+		c->acct.shape_notifies, c->acct.shape_notifies / secs,
+		c->acct.other_events);
+	LOG_INFO("      requests made %lu (%.2f/s)\n", c->acct.requests,
+		c->acct.requests / secs);
+	qsort(c->acct.atoms, c->acct.num_atoms, sizeof(struct atom_count),
+		cmp_atom_count);
+	for (int i = 0; i < c->acct.num_atoms && i < TOP_ATOMS; i++) {
+		char       *name = XGetAtomName(dpy, c->acct.atoms[i].atom);
+
+		LOG_INFO("      %s: %lu (%.2f/s)\n", name ? name : "?",
+			c->acct.atoms[i].count,
+			c->acct.atoms[i].count / secs);
+		if (name)
+			XFree(name);
+	}
+}
+
+static void
+dump_busiest_clients(void)
+{
+	struct list *iter;
+	int         n = 0, i;
+	long long   now = monotonic_msec();
+
+	for (iter = clients_tab_order; iter; iter = iter->next)
+		n++;
+	if (!n)
+		return;
+
+	struct client     *sorted[n];
+
+	i = 0;
+	for (iter = clients_tab_order; iter; iter = iter->next)
+		sorted[i++] = iter->data;
+	qsort(sorted, n, sizeof(struct client *), cmp_load);
+	LOG_INFO("  busiest clients:\n");
+	for (i = 0; i < n && i < TOP_CLIENTS; i++)
+		dump_client_acct(sorted[i], now);
+}
+
+void
+stats_dump(void)
+{
+	struct list *iter;
+
+	LOG_INFO("evilwm " VERSION " statistics:\n");
+	LOG_INFO("  vdesk switches:   %lu (%lu more coalesced)\n",
+		stats.vdesk_switches, stats.vdesk_switches_coalesced);
+	LOG_INFO("    frames unmapped: %lu (last switch: %u)\n",
+		stats.vdesk_unmapped, stats.last_switch.unmapped);
+	LOG_INFO("    frames mapped:   %lu (last switch: %u)\n",
+		stats.vdesk_mapped, stats.last_switch.mapped);
+	LOG_INFO("    frames exposed:  %lu (last switch: %u)\n",
+		stats.vdesk_exposed, stats.last_switch.exposed);
+	LOG_INFO("  occlusion checks: %lu (%lu state changes)\n",
+		stats.occlusion_checks, stats.occlusion_changes);
+	LOG_INFO("  key repeats folded: %lu\n", stats.key_repeats_folded);
+	LOG_INFO("  configure requests: %lu sent, %lu suppressed\n",
+		stats.geometry_sent, stats.geometry_suppressed);
+	LOG_INFO("  synthetic ConfigureNotify: %lu sent, %lu suppressed\n",
+		stats.config_notify_sent, stats.config_notify_suppressed);
+	LOG_INFO("  ConfigureRequests: %lu no-op, %lu refused\n",
+		stats.configure_noop, stats.configure_refused);
+	for (iter = clients_tab_order; iter; iter = iter->next) {
+		struct client     *c = iter->data;
+
+		if (c->configures_refused) {
+			LOG_INFO("    window 0x%lx (pid %ld): %lu refused\n",
+				c->window, (long) c->pid,
+				c->configures_refused);
+		}
+	}
+	LOG_INFO("  config reloads: %lu (last took %lldms)\n", stats.reloads,
+		stats.last_reload_msec);
+	if (stats.handover_msec) {
+		LOG_INFO("  replaced previous window manager in %lldms\n",
+			stats.handover_msec);
+	}
+	dump_busiest_clients();
+	freeze_dump_stats();
+	boost_dump_stats();
+#ifdef STDIO
+	fflush(stdout);
+#endif
+}
@@ -0,0 +1,220 @@
+/* evilwm - Minimalist Window Manager for X
+ * Copyright (C) 1999-2011 Ciaran Anscomb <evilwm@6809.org.uk>
+ * see README for license and other details. */
+
+/* Case-insensitive substring search over a set of strings.
+ *
+ * An index holds a lower-cased copy of each string, the strings' ids
+ * sorted by that copy, and a posting for every distinct (trigram, id)
+ * pair, sorted by trigram.  Strings starting with the query are found by
+ * binary search on the sorted ids and come first; other strings
+ * containing the query are then found by checking only those listed under
+ * the query's rarest trigram.  Queries too short to have a trigram fall
+ * back to checking every string. */
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "evilwm.h"
+#include "log.h"
+
+#define MAX_QUERY 256
+
+struct trigram_posting
+{
+	uint32_t    tri;
+	int         id;
+};
+
+static uint32_t
+trigram_at(const char *s)
+{
+	return (uint32_t) (unsigned char) s[0] << 16
+		| (uint32_t) (unsigned char) s[1] << 8
+		| (unsigned char) s[2];
+}
+
+static void
+lower_copy(char *dst, const char *src, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		dst[i] = tolower((unsigned char) src[i]);
+	dst[len] = 0;
+}
+
+/* qsort() has no context argument, so key order is found through this */
+static char **sort_keys;
+
+static int
+cmp_key(const void *a, const void *b)
+{
+	return strcmp(sort_keys[*(const int *) a], sort_keys[*(const int *) b]);
+}
+
+static int
+cmp_posting(const void *a, const void *b)
+{
+	const struct trigram_posting *pa = a, *pb = b;
+
+	if (pa->tri != pb->tri)
+		return pa->tri < pb->tri ? -1 : 1;
+	return pa->id - pb->id;
+}
+
+/** trigram_build:
+ *  Index @n strings, which are referred to by their position in @strings.
+ *  The strings themselves are copied.  Returns 0 if out of memory, leaving
+ *  an empty index.
+ */
+int
+trigram_build(struct trigram_index * t, const char *const *strings, int n)
+{
+	int         np = 0, i;
+
+	memset(t, 0, sizeof(*t));
+	if (n <= 0)
+		return 1;
+	t->keys = calloc(n, sizeof(char *));
+	t->sorted = malloc(n * sizeof(int));
+	if (!t->keys || !t->sorted)
+		goto oom;
+	t->nkeys = n;
+	for (i = 0; i < n; i++) {
+		size_t      len = strlen(strings[i]);
+
+		if (!(t->keys[i] = malloc(len + 1)))
+			goto oom;
+		lower_copy(t->keys[i], strings[i], len);
+		t->sorted[i] = i;
+		if (len >= 3)
+			np += len - 2;
+	}
+	sort_keys = t->keys;
+	qsort(t->sorted, n, sizeof(int), cmp_key);
+
+	if (np && !(t->postings = malloc(np * sizeof(struct trigram_posting))))
+		goto oom;
+	np = 0;
+	for (i = 0; i < n; i++) {
+		for (const char *s = t->keys[i]; s[0] && s[1] && s[2]; s++) {
+			t->postings[np].tri = trigram_at(s);
+			t->postings[np].id = i;
+			np++;
+		}
+	}
+	qsort(t->postings, np, sizeof(struct trigram_posting), cmp_posting);
+	/* A trigram repeated within one string is listed once */
+	t->npostings = 0;
+	for (i = 0; i < np; i++) {
+		if (t->npostings
+			&& !cmp_posting(&t->postings[t->npostings - 1],
+				&t->postings[i]))
+			continue;
+		t->postings[t->npostings++] = t->postings[i];
+	}
+	LOG_DEBUG("indexed %d strings, %d trigrams\n", t->nkeys, t->npostings);
+	return 1;
+ oom:
+	LOG_ERROR("out of memory building search index\n");
+	trigram_free(t);
+	return 0;
+}
+
+void
+trigram_free(struct trigram_index * t)
+{
+	if (t->keys) {
+		for (int i = 0; i < t->nkeys; i++)
+			free(t->keys[i]);
+	}
+	free(t->keys);
+	free(t->sorted);
+	free(t->postings);
+	memset(t, 0, sizeof(*t));
+}
+
+/* First posting for trigram @tri, or where it would be */
+static int
+postings_find(const struct trigram_index * t, uint32_t tri)
+{
+	int         lo = 0, hi = t->npostings;
+
+	while (lo < hi) {
+		int         mid = lo + (hi - lo) / 2;
+
+		if (t->postings[mid].tri < tri)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/** trigram_search:
+ *  Find up to @max strings containing @query, ignoring case, and store
+ *  their ids in @results.  Strings starting with @query are listed first,
+ *  in sorted order.  Returns the number found.
+ */
+int
+trigram_search(const struct trigram_index * t, const char *query,
+	int *results, int max)
+{
+	char        q[MAX_QUERY];
+	size_t      qlen = strlen(query);
+	int         n = 0, lo = 0, hi = t->nkeys;
+	int         first, last;
+
+	if (qlen >= MAX_QUERY)
+		qlen = MAX_QUERY - 1;
+	lower_copy(q, query, qlen);
+
+	/* Prefix matches: binary search for the first key >= q */
+	while (lo < hi) {
+		int         mid = lo + (hi - lo) / 2;
+
+		if (strcmp(t->keys[t->sorted[mid]], q) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < t->nkeys && n < max; lo++) {
+		if (strncmp(t->keys[t->sorted[lo]], q, qlen) != 0)
+			break;
+		results[n++] = t->sorted[lo];
+	}
+	if (n >= max || !qlen)
+		return n;
+
+	/* Other substring matches */
+	if (qlen < 3) {
+		for (int i = 0; i < t->nkeys && n < max; i++) {
+			const char *k = t->keys[i];
+
+			if (strncmp(k, q, qlen) != 0 && strstr(k, q))
+				results[n++] = i;
+		}
+		return n;
+	}
+	first = last = -1;
+	for (size_t i = 0; i + 3 <= qlen; i++) {
+		uint32_t    tri = trigram_at(q + i);
+		int         s = postings_find(t, tri), e = s;
+
+		while (e < t->npostings && t->postings[e].tri == tri)
+			e++;
+		if (first < 0 || e - s < last - first) {
+			first = s;
+			last = e;
+		}
+		if (s == e)
+			return n;
+	}
+	for (int i = first; i < last && n < max; i++) {
+		const char *k = t->keys[t->postings[i].id];
+
+		if (strncmp(k, q, qlen) != 0 && strstr(k, q))
+			results[n++] = t->postings[i].id;
+	}
+	return n;
+}